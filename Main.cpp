@@ -15,12 +15,30 @@
 #include <climits>
 #include <atomic>
 #include <thread>
+#include <memory>
+#include <new>
+#include <functional>
+
+#if defined(__BMI2__) && !defined(NO_PEXT)
+#define USE_PEXT
+#endif
+#if defined(__AVX2__)
+#define USE_AVX2
+#elif defined(__SSSE3__)
+#define USE_SSSE3
+#endif
+#if defined(USE_PEXT) || defined(USE_AVX2) || defined(USE_SSSE3)
+#include <immintrin.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
 namespace fs = std::filesystem;
 
 // Constants & Types
-enum class Color { WHITE = 0, BLACK = 1, NONE = 2 };
-enum class PieceType { PAWN = 0, KNIGHT = 1, BISHOP = 2, ROOK = 3, QUEEN = 4, KING = 5, NONE = 6 };
+enum class Color : uint8_t { WHITE = 0, BLACK = 1, NONE = 2 };
+enum class PieceType : uint8_t { PAWN = 0, KNIGHT = 1, BISHOP = 2, ROOK = 3, QUEEN = 4, KING = 5, NONE = 6 };
 enum class Square : uint8_t {
     A1, B1, C1, D1, E1, F1, G1, H1,
     A2, B2, C2, D2, E2, F2, G2, H2,
@@ -40,61 +58,134 @@ struct Piece {
     Color color;
 };
 
-struct Move {
-    Square from;
-    Square to;
-    PieceType promotion;
-    int score = 0;
+constexpr Piece NO_PIECE = {PieceType::NONE, Color::NONE};
+
+// Packed into 32 bits and filled in once by the move generator:
+// bits 0-5 from, 6-11 to, 12-14 promotion (0 = none), 15-17 flags,
+// 18-20 moved piece, 21-23 captured piece. The low 16 bits identify the
+// move within its position and are what the transposition table keeps.
+class Move {
+private:
+    uint32_t data_ = 0;
     
-    Move(Square f = Square::NONE, Square t = Square::NONE, PieceType p = PieceType::NONE)
-        : from(f), to(t), promotion(p) {}
+public:
+    static constexpr uint32_t CAPTURE = 1 << 15;
+    static constexpr uint32_t EN_PASSANT = 1 << 16;
+    static constexpr uint32_t CASTLING = 1 << 17;
     
-    bool operator==(const Move& other) const {
-        return from == other.from && to == other.to && promotion == other.promotion;
+    constexpr Move() = default;
+    constexpr Move(int from, int to, PieceType moved, PieceType captured = PieceType::NONE,
+                   PieceType promotion = PieceType::NONE, uint32_t flags = 0)
+        : data_(pack(from, to, promotion) | flags | (captured != PieceType::NONE ? CAPTURE : 0) |
+                static_cast<uint32_t>(moved) << 18 | static_cast<uint32_t>(captured) << 21) {}
+    
+    static constexpr uint16_t pack(int from, int to, PieceType promotion) {
+        int promo = promotion == PieceType::NONE ? 0 : static_cast<int>(promotion);
+        return static_cast<uint16_t>(from | to << 6 | promo << 12);
     }
     
-    bool operator!=(const Move& other) const {
-        return !(*this == other);
+    Square from() const { return static_cast<Square>(data_ & 0x3F); }
+    Square to() const { return static_cast<Square>((data_ >> 6) & 0x3F); }
+    PieceType promotion() const {
+        uint32_t promo = (data_ >> 12) & 0x7;
+        return promo ? static_cast<PieceType>(promo) : PieceType::NONE;
     }
+    PieceType moved() const { return static_cast<PieceType>((data_ >> 18) & 0x7); }
+    PieceType captured() const { return static_cast<PieceType>((data_ >> 21) & 0x7); }
+    
+    bool isCapture() const { return data_ & CAPTURE; }
+    bool isPromotion() const { return data_ & 0x7000; }
+    bool isEnPassant() const { return data_ & EN_PASSANT; }
+    bool isCastling() const { return data_ & CASTLING; }
+    bool isNull() const { return data_ == 0; }
+    
+    uint16_t compact() const { return static_cast<uint16_t>(data_ & 0x7FFF); }
+    
+    bool operator==(const Move& other) const { return data_ == other.data_; }
+    bool operator!=(const Move& other) const { return data_ != other.data_; }
     
     std::string toUci() const {
         static const char* files = "abcdefgh";
         static const char* ranks = "12345678";
-        if (from == Square::NONE || to == Square::NONE) return "0000";
+        if (isNull()) return "0000";
+        int f = static_cast<int>(from()), t = static_cast<int>(to());
         std::string uci;
-        uci += files[static_cast<int>(from) % 8];
-        uci += ranks[static_cast<int>(from) / 8];
-        uci += files[static_cast<int>(to) % 8];
-        uci += ranks[static_cast<int>(to) / 8];
-        if (promotion != PieceType::NONE) {
+        uci += files[f % 8];
+        uci += ranks[f / 8];
+        uci += files[t % 8];
+        uci += ranks[t / 8];
+        if (isPromotion()) {
             static const char* promos = " nbrq";
-            uci += promos[static_cast<int>(promotion)];
+            uci += promos[static_cast<int>(promotion())];
         }
         return uci;
     }
     
     struct Hash {
-        size_t operator()(const Move& m) const {
-            return static_cast<size_t>(static_cast<int>(m.from) * 64 + static_cast<int>(m.to));
-        }
+        size_t operator()(const Move& m) const { return m.data_; }
     };
 };
 
+// Fixed-capacity move list living on the stack. The storage is left
+// uninitialised; only the first count_ entries are ever read.
+constexpr int MAX_MOVES = 256;
+
+class MoveList {
+private:
+    union { Move moves_[MAX_MOVES]; };
+    int count_ = 0;
+    
+public:
+    MoveList() {}
+    MoveList(const MoveList& other) : count_(other.count_) {
+        std::copy(other.begin(), other.end(), moves_);
+    }
+    MoveList& operator=(const MoveList& other) {
+        count_ = other.count_;
+        std::copy(other.begin(), other.end(), moves_);
+        return *this;
+    }
+    
+    void push_back(const Move& move) { moves_[count_++] = move; }
+    template <typename... Args>
+    void emplace_back(Args... args) { moves_[count_++] = Move(args...); }
+    void clear() { count_ = 0; }
+    void resize(int n) { count_ = n; }  // shrink only
+    
+    int size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    Move& operator[](int i) { return moves_[i]; }
+    const Move& operator[](int i) const { return moves_[i]; }
+    Move* begin() { return moves_; }
+    Move* end() { return moves_ + count_; }
+    const Move* begin() const { return moves_; }
+    const Move* end() const { return moves_ + count_; }
+    
+    bool contains(const Move& move) const {
+        return std::find(begin(), end(), move) != end();
+    }
+};
+
+enum class GenType { CAPTURES, QUIETS, EVASIONS, LEGAL };
+
 inline int popcount(uint64_t x) { return __builtin_popcountll(x); }
 inline int lsbIndex(uint64_t x) { return __builtin_ctzll(x); }
 
-// Board State
-struct BoardState {
-    uint64_t pieces[2][6];
-    uint64_t occupied;
-    uint64_t empty;
-    Color sideToMove;
+// Undo Record
+// Everything make/unmake cannot recompute. Kept in a fixed array inside
+// Board, so making a move never allocates.
+struct UndoInfo {
+    uint64_t hash;
+    uint64_t pawnKey;
+    Move move;
+    uint8_t castling;
     Square enPassant;
-    bool castlingRights[2][2];
-    int halfmoveClock;
-    int fullmoveNumber;
+    int16_t halfmoveClock;
+    int16_t pliesFromNull;
 };
 
+constexpr int MAX_GAME_PLY = 1024;
+
 // Attack Tables
 namespace Attacks {
     const std::array<int, 8> KNIGHT_DELTAS = {-17, -15, -10, -6, 6, 10, 15, 17};
@@ -102,13 +193,13 @@ namespace Attacks {
     
     inline uint64_t pawnAttacks(Color color, uint64_t pawns) {
         if (color == Color::WHITE) {
-            return ((pawns << 7) & ~0x0101010101010101ULL) | ((pawns << 9) & ~0x8080808080808080ULL);
+            return ((pawns << 7) & ~0x8080808080808080ULL) | ((pawns << 9) & ~0x0101010101010101ULL);
         } else {
-            return ((pawns >> 7) & ~0x8080808080808080ULL) | ((pawns >> 9) & ~0x0101010101010101ULL);
+            return ((pawns >> 7) & ~0x0101010101010101ULL) | ((pawns >> 9) & ~0x8080808080808080ULL);
         }
     }
     
-    inline uint64_t knightAttacks(Square sq) {
+    inline uint64_t knightJumps(Square sq) {
         int s = static_cast<int>(sq);
         uint64_t bb = 0;
         if (s % 8 > 0 && s / 8 > 1) bb |= (1ULL << (s - 17));
@@ -122,7 +213,7 @@ namespace Attacks {
         return bb;
     }
     
-    inline uint64_t kingAttacks(Square sq) {
+    inline uint64_t kingSteps(Square sq) {
         int s = static_cast<int>(sq);
         uint64_t bb = 0;
         if (s % 8 > 0 && s / 8 > 0) bb |= (1ULL << (s - 9));
@@ -136,7 +227,7 @@ namespace Attacks {
         return bb;
     }
     
-    inline uint64_t rookAttacks(Square sq, uint64_t occupied) {
+    inline uint64_t rookRays(Square sq, uint64_t occupied) {
         int s = static_cast<int>(sq);
         uint64_t attacks = 0;
         int r = s / 8, f = s % 8;
@@ -164,7 +255,7 @@ namespace Attacks {
         return attacks;
     }
     
-    inline uint64_t bishopAttacks(Square sq, uint64_t occupied) {
+    inline uint64_t bishopRays(Square sq, uint64_t occupied) {
         int s = static_cast<int>(sq);
         uint64_t attacks = 0;
         int r = s / 8, f = s % 8;
@@ -192,240 +283,891 @@ namespace Attacks {
         return attacks;
     }
     
+    // Magic bitboards: the relevant occupancy of a slider is hashed into a
+    // per-square slice of a shared attack table. With BMI2 the hash is a PEXT.
+    struct Magic {
+        uint64_t mask;
+        uint64_t magic;
+        uint64_t* attacks;
+        int shift;
+        
+        inline unsigned index(uint64_t occupied) const {
+#if defined(USE_PEXT)
+            return static_cast<unsigned>(_pext_u64(occupied, mask));
+#else
+            return static_cast<unsigned>(((occupied & mask) * magic) >> shift);
+#endif
+        }
+    };
+    
+    inline std::array<Magic, 64> ROOK_MAGICS;
+    inline std::array<Magic, 64> BISHOP_MAGICS;
+    inline std::array<uint64_t, 0x19000> ROOK_TABLE;
+    inline std::array<uint64_t, 0x1480> BISHOP_TABLE;
+    
+    inline void initMagics(std::array<Magic, 64>& magics, uint64_t* table,
+                           uint64_t (*rays)(Square, uint64_t)) {
+        std::vector<uint64_t> occupancy(4096), reference(4096);
+#if !defined(USE_PEXT)
+        std::vector<int> epoch(4096, 0);
+        std::mt19937_64 rng(0x48554e59414449ULL);
+        int attempt = 0;
+#endif
+        uint64_t* slice = table;
+        
+        for (int s = 0; s < 64; ++s) {
+            Magic& m = magics[s];
+            uint64_t rankEdges = (0x00000000000000FFULL | 0xFF00000000000000ULL) & ~(0x00000000000000FFULL << ((s / 8) * 8));
+            uint64_t fileEdges = (0x0101010101010101ULL | 0x8080808080808080ULL) & ~(0x0101010101010101ULL << (s % 8));
+            m.mask = rays(static_cast<Square>(s), 0) & ~(rankEdges | fileEdges);
+            m.shift = 64 - popcount(m.mask);
+            m.attacks = slice;
+            
+            int size = 0;
+            uint64_t subset = 0;
+            do {
+                occupancy[size] = subset;
+                reference[size] = rays(static_cast<Square>(s), subset);
+#if defined(USE_PEXT)
+                m.attacks[_pext_u64(subset, m.mask)] = reference[size];
+#endif
+                ++size;
+                subset = (subset - m.mask) & m.mask;
+            } while (subset);
+            slice += size;
+            
+#if !defined(USE_PEXT)
+            for (int i = 0; i < size; ) {
+                m.magic = 0;
+                while (popcount((m.mask * m.magic) >> 56) < 6) {
+                    m.magic = rng() & rng() & rng();
+                }
+                ++attempt;
+                for (i = 0; i < size; ++i) {
+                    unsigned idx = m.index(occupancy[i]);
+                    if (epoch[idx] < attempt) {
+                        epoch[idx] = attempt;
+                        m.attacks[idx] = reference[i];
+                    } else if (m.attacks[idx] != reference[i]) {
+                        break;
+                    }
+                }
+            }
+#endif
+        }
+    }
+    
+    inline std::array<uint64_t, 64> KNIGHT_ATTACKS;
+    inline std::array<uint64_t, 64> KING_ATTACKS;
+    inline std::array<std::array<uint64_t, 64>, 2> PAWN_ATTACKS;
+    // BETWEEN: squares strictly between two aligned squares.
+    // LINE: the whole rank, file or diagonal through both (0 if not aligned).
+    inline std::array<std::array<uint64_t, 64>, 64> BETWEEN;
+    inline std::array<std::array<uint64_t, 64>, 64> LINE;
+    // PASSED_PAWN: squares ahead of a pawn on its own and adjacent files.
+    // ADJACENT_FILES: the files either side of a file.
+    inline std::array<std::array<uint64_t, 64>, 2> PASSED_PAWN;
+    inline std::array<uint64_t, 8> ADJACENT_FILES;
+    
+    // Every square on or in front of bb, seen from color.
+    inline uint64_t frontFill(Color color, uint64_t bb) {
+        if (color == Color::WHITE) {
+            bb |= bb << 8; bb |= bb << 16; bb |= bb << 32;
+        } else {
+            bb |= bb >> 8; bb |= bb >> 16; bb |= bb >> 32;
+        }
+        return bb;
+    }
+    
+    inline void init() {
+        initMagics(ROOK_MAGICS, ROOK_TABLE.data(), rookRays);
+        initMagics(BISHOP_MAGICS, BISHOP_TABLE.data(), bishopRays);
+        
+        for (int s = 0; s < 64; ++s) {
+            uint64_t bb = 1ULL << s;
+            KNIGHT_ATTACKS[s] = knightJumps(static_cast<Square>(s));
+            KING_ATTACKS[s] = kingSteps(static_cast<Square>(s));
+            PAWN_ATTACKS[0][s] = pawnAttacks(Color::WHITE, bb);
+            PAWN_ATTACKS[1][s] = pawnAttacks(Color::BLACK, bb);
+        }
+        
+        for (int f = 0; f < 8; ++f) {
+            ADJACENT_FILES[f] = 0;
+            if (f > 0) ADJACENT_FILES[f] |= 0x0101010101010101ULL << (f - 1);
+            if (f < 7) ADJACENT_FILES[f] |= 0x0101010101010101ULL << (f + 1);
+        }
+        for (int s = 0; s < 64; ++s) {
+            int rank = s / 8;
+            uint64_t files = ADJACENT_FILES[s % 8] | (0x0101010101010101ULL << (s % 8));
+            PASSED_PAWN[0][s] = rank < 7 ? files & (~0ULL << ((rank + 1) * 8)) : 0;
+            PASSED_PAWN[1][s] = files & ((1ULL << (rank * 8)) - 1);
+        }
+        
+        for (int a = 0; a < 64; ++a) {
+            for (int b = 0; b < 64; ++b) {
+                BETWEEN[a][b] = LINE[a][b] = 0;
+                if (a == b) continue;
+                Square sa = static_cast<Square>(a), sb = static_cast<Square>(b);
+                uint64_t ends = (1ULL << a) | (1ULL << b);
+                if (rookRays(sa, 0) & (1ULL << b)) {
+                    BETWEEN[a][b] = rookRays(sa, 1ULL << b) & rookRays(sb, 1ULL << a);
+                    LINE[a][b] = (rookRays(sa, 0) & rookRays(sb, 0)) | ends;
+                } else if (bishopRays(sa, 0) & (1ULL << b)) {
+                    BETWEEN[a][b] = bishopRays(sa, 1ULL << b) & bishopRays(sb, 1ULL << a);
+                    LINE[a][b] = (bishopRays(sa, 0) & bishopRays(sb, 0)) | ends;
+                }
+            }
+        }
+    }
+    
+    inline uint64_t knightAttacks(Square sq) {
+        return KNIGHT_ATTACKS[static_cast<int>(sq)];
+    }
+    
+    inline uint64_t kingAttacks(Square sq) {
+        return KING_ATTACKS[static_cast<int>(sq)];
+    }
+    
+    inline uint64_t pawnAttacks(Color color, Square sq) {
+        return PAWN_ATTACKS[static_cast<int>(color)][static_cast<int>(sq)];
+    }
+    
+    inline uint64_t rookAttacks(Square sq, uint64_t occupied) {
+        const Magic& m = ROOK_MAGICS[static_cast<int>(sq)];
+        return m.attacks[m.index(occupied)];
+    }
+    
+    inline uint64_t bishopAttacks(Square sq, uint64_t occupied) {
+        const Magic& m = BISHOP_MAGICS[static_cast<int>(sq)];
+        return m.attacks[m.index(occupied)];
+    }
+    
     inline uint64_t queenAttacks(Square sq, uint64_t occupied) {
         return rookAttacks(sq, occupied) | bishopAttacks(sq, occupied);
     }
 }
 
+// Attack Info
+// Check and pin data for one position, computed once per node by
+// Board::computeAttackInfo() and shared by move generation, legality
+// checks and move ordering.
+struct AttackInfo {
+    uint64_t checkers = 0;  // pieces giving check to the side to move
+    uint64_t pinned = 0;    // side to move's pieces pinned to its king
+    std::array<uint64_t, 6> checkSquares = {};  // where each piece type would check the enemy king
+};
+
+// Zobrist Keys
+namespace Zobrist {
+    inline uint64_t PIECES[2][6][64];
+    inline uint64_t CASTLING[16];
+    inline uint64_t EN_PASSANT[8];
+    inline uint64_t SIDE;
+    
+    // Cuckoo hash of every reversible move: a non-pawn piece going between
+    // two squares it connects on an empty board, keyed by the hash change the
+    // move makes (side to move included). Used to spot upcoming repetitions.
+    inline std::array<uint64_t, 8192> CUCKOO_KEYS;
+    inline std::array<uint16_t, 8192> CUCKOO_MOVES;
+    
+    inline int cuckooH1(uint64_t key) { return static_cast<int>(key & 0x1FFF); }
+    inline int cuckooH2(uint64_t key) { return static_cast<int>((key >> 16) & 0x1FFF); }
+    
+    // Needs Attacks::init() first.
+    inline void init() {
+        std::mt19937_64 rng(0x484f4e59414449ULL);
+        for (auto& color : PIECES)
+            for (auto& piece : color)
+                for (auto& key : piece) key = rng();
+        for (auto& key : CASTLING) key = rng();
+        for (auto& key : EN_PASSANT) key = rng();
+        SIDE = rng();
+        
+        CUCKOO_KEYS.fill(0);
+        CUCKOO_MOVES.fill(0);
+        for (int c = 0; c < 2; ++c) {
+            for (int p = 1; p < 6; ++p) {
+                for (int s1 = 0; s1 < 64; ++s1) {
+                    Square sq = static_cast<Square>(s1);
+                    uint64_t reach = p == 1 ? Attacks::knightAttacks(sq) :
+                                     p == 2 ? Attacks::bishopAttacks(sq, 0) :
+                                     p == 3 ? Attacks::rookAttacks(sq, 0) :
+                                     p == 4 ? Attacks::queenAttacks(sq, 0) : Attacks::kingAttacks(sq);
+                    for (int s2 = s1 + 1; s2 < 64; ++s2) {
+                        if (!(reach & (1ULL << s2))) continue;
+                        uint16_t move = Move::pack(s1, s2, PieceType::NONE);
+                        uint64_t key = PIECES[c][p][s1] ^ PIECES[c][p][s2] ^ SIDE;
+                        int i = cuckooH1(key);
+                        while (true) {
+                            std::swap(CUCKOO_KEYS[i], key);
+                            std::swap(CUCKOO_MOVES[i], move);
+                            if (move == 0) break;
+                            i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Material and Piece-Square Tables
+// MG/EG fold the piece value into the square bonus, mirrored for black and
+// negated so that summing over all pieces gives the white-relative score.
+namespace Pst {
+    inline constexpr std::array<int, 6> PIECE_VALUES = {100, 320, 330, 500, 900, 20000};
+    inline constexpr std::array<int, 6> PHASE = {0, 1, 1, 2, 4, 0};
+    
+    inline constexpr std::array<int, 64> PAWN_MG = {
+         0,  0,  0,  0,  0,  0,  0,  0,
+         5, 10, 10,-20,-20, 10, 10,  5,
+         5, -5,-10,  0,  0,-10, -5,  5,
+         0,  0,  0, 20, 20,  0,  0,  0,
+         5,  5, 10, 25, 25, 10,  5,  5,
+        10, 10, 20, 30, 30, 20, 10, 10,
+        50, 50, 50, 50, 50, 50, 50, 50,
+         0,  0,  0,  0,  0,  0,  0,  0
+    };
+    
+    inline constexpr std::array<int, 64> PAWN_EG = {
+         0,  0,  0,  0,  0,  0,  0,  0,
+        10, 10, 10, 10, 10, 10, 10, 10,
+        10, 10, 10, 10, 10, 10, 10, 10,
+        20, 20, 20, 20, 20, 20, 20, 20,
+        30, 30, 30, 30, 30, 30, 30, 30,
+        40, 40, 40, 40, 40, 40, 40, 40,
+        50, 50, 50, 50, 50, 50, 50, 50,
+         0,  0,  0,  0,  0,  0,  0,  0
+    };
+    
+    inline constexpr std::array<int, 64> KNIGHT = {
+        -50,-40,-30,-30,-30,-30,-40,-50,
+        -40,-20,  0,  5,  5,  0,-20,-40,
+        -30,  5, 10, 15, 15, 10,  5,-30,
+        -30,  0, 15, 20, 20, 15,  0,-30,
+        -30,  5, 15, 20, 20, 15,  5,-30,
+        -30,  0, 10, 15, 15, 10,  0,-30,
+        -40,-20,  0,  0,  0,  0,-20,-40,
+        -50,-40,-30,-30,-30,-30,-40,-50
+    };
+    
+    inline constexpr std::array<int, 64> BISHOP = {
+        -20,-10,-10,-10,-10,-10,-10,-20,
+        -10,  5,  0,  0,  0,  0,  5,-10,
+        -10, 10, 10, 10, 10, 10, 10,-10,
+        -10,  0, 10, 10, 10, 10,  0,-10,
+        -10,  5,  5, 10, 10,  5,  5,-10,
+        -10,  0,  5, 10, 10,  5,  0,-10,
+        -10,  0,  0,  0,  0,  0,  0,-10,
+        -20,-10,-10,-10,-10,-10,-10,-20
+    };
+    
+    inline constexpr std::array<int, 64> ROOK = {
+         0,  0,  0,  5,  5,  0,  0,  0,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+        -5,  0,  0,  0,  0,  0,  0, -5,
+         5, 10, 10, 10, 10, 10, 10,  5,
+         0,  0,  0,  0,  0,  0,  0,  0
+    };
+    
+    inline constexpr std::array<int, 64> QUEEN = {
+        -20,-10,-10, -5, -5,-10,-10,-20,
+        -10,  0,  5,  0,  0,  0,  0,-10,
+        -10,  5,  5,  5,  5,  5,  0,-10,
+          0,  0,  5,  5,  5,  5,  0, -5,
+         -5,  0,  5,  5,  5,  5,  0, -5,
+        -10,  0,  5,  5,  5,  5,  0,-10,
+        -10,  0,  0,  0,  0,  0,  0,-10,
+        -20,-10,-10, -5, -5,-10,-10,-20
+    };
+    
+    inline constexpr std::array<int, 64> KING_MG = {
+        20, 30, 10,  0,  0, 10, 30, 20,
+        20, 20,  0,  0,  0,  0, 20, 20,
+        -10,-20,-20,-20,-20,-20,-20,-10,
+        -20,-30,-30,-40,-40,-30,-30,-20,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30,
+        -30,-40,-40,-50,-50,-40,-40,-30
+    };
+    
+    inline constexpr std::array<int, 64> KING_EG = {
+        -50,-30,-30,-30,-30,-30,-30,-50,
+        -30,-30,  0,  0,  0,  0,-30,-30,
+        -30,-10, 20, 30, 30, 20,-10,-30,
+        -30,-10, 30, 40, 40, 30,-10,-30,
+        -30,-10, 30, 40, 40, 30,-10,-30,
+        -30,-10, 20, 30, 30, 20,-10,-30,
+        -30,-20,-10,  0,  0,-10,-20,-30,
+        -50,-40,-30,-20,-20,-30,-40,-50
+    };
+    
+    inline int MG[2][6][64];
+    inline int EG[2][6][64];
+    
+    inline void init() {
+        const std::array<int, 64>* mg[6] = {&PAWN_MG, &KNIGHT, &BISHOP, &ROOK, &QUEEN, &KING_MG};
+        const std::array<int, 64>* eg[6] = {&PAWN_EG, &KNIGHT, &BISHOP, &ROOK, &QUEEN, &KING_EG};
+        for (int p = 0; p < 6; ++p) {
+            for (int sq = 0; sq < 64; ++sq) {
+                MG[0][p][sq] = PIECE_VALUES[p] + (*mg[p])[sq];
+                EG[0][p][sq] = PIECE_VALUES[p] + (*eg[p])[sq];
+                MG[1][p][sq] = -(PIECE_VALUES[p] + (*mg[p])[63 - sq]);
+                EG[1][p][sq] = -(PIECE_VALUES[p] + (*eg[p])[63 - sq]);
+            }
+        }
+    }
+}
+
+// NNUE Evaluation
+// HalfKP-style network. Each side's accumulator sums int16 weight columns
+// for every non-king piece, indexed by that side's king square; Board keeps
+// both accumulators up to date in make/unmake. Evaluation clips them to
+// [0, 127], runs a 32-neuron int8 layer and an int8 output neuron.
+namespace Nnue {
+    constexpr int HALF_DIMS = 256;
+    constexpr int INPUTS = 64 * 640;
+    constexpr int L1 = 32;
+    constexpr int WEIGHT_SHIFT = 6;
+    constexpr int OUTPUT_SCALE = 16;
+    constexpr uint32_t MAGIC = 0x4E4E5548;  // "HUNN"
+    
+    struct alignas(64) Accumulator {
+        int16_t values[2][HALF_DIMS];
+    };
+    
+    struct Network {
+        alignas(64) int16_t ftBias[HALF_DIMS];
+        alignas(64) int16_t ftWeights[INPUTS * HALF_DIMS];
+        alignas(64) int32_t l1Bias[L1];
+        alignas(64) int8_t l1Weights[L1 * 2 * HALF_DIMS];
+        alignas(64) int8_t outWeights[L1];
+        int32_t outBias;
+    };
+    
+    inline std::unique_ptr<Network> network;
+    inline const Network* active = nullptr;  // set while the UseNNUE option is on and a net is loaded
+    
+    inline int featureIndex(Color perspective, int kingSq, Piece piece, int sq) {
+        int flip = (perspective == Color::WHITE) ? 0 : 56;
+        int pieceIndex = static_cast<int>(piece.type) * 2 + (piece.color != perspective);
+        return (kingSq ^ flip) * 640 + pieceIndex * 64 + (sq ^ flip);
+    }
+    
+    template <bool Add>
+    inline void update(int16_t* acc, int feature) {
+        const int16_t* w = &active->ftWeights[feature * HALF_DIMS];
+#if defined(USE_AVX2)
+        for (int i = 0; i < HALF_DIMS; i += 16) {
+            __m256i a = _mm256_load_si256(reinterpret_cast<const __m256i*>(acc + i));
+            __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(w + i));
+            a = Add ? _mm256_add_epi16(a, b) : _mm256_sub_epi16(a, b);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(acc + i), a);
+        }
+#elif defined(USE_SSSE3)
+        for (int i = 0; i < HALF_DIMS; i += 8) {
+            __m128i a = _mm_load_si128(reinterpret_cast<const __m128i*>(acc + i));
+            __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(w + i));
+            a = Add ? _mm_add_epi16(a, b) : _mm_sub_epi16(a, b);
+            _mm_store_si128(reinterpret_cast<__m128i*>(acc + i), a);
+        }
+#else
+        for (int i = 0; i < HALF_DIMS; ++i) acc[i] = Add ? acc[i] + w[i] : acc[i] - w[i];
+#endif
+    }
+    
+    inline void clip(const int16_t* in, uint8_t* out) {
+#if defined(USE_AVX2)
+        const __m256i zero = _mm256_setzero_si256();
+        for (int i = 0; i < HALF_DIMS; i += 32) {
+            __m256i a = _mm256_max_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(in + i)), zero);
+            __m256i b = _mm256_max_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(in + i + 16)), zero);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(a, b), 0xD8);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(out + i), packed);
+        }
+#elif defined(USE_SSSE3)
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < HALF_DIMS; i += 16) {
+            __m128i a = _mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(in + i)), zero);
+            __m128i b = _mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(in + i + 8)), zero);
+            _mm_store_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi16(a, b));
+        }
+#else
+        for (int i = 0; i < HALF_DIMS; ++i) out[i] = static_cast<uint8_t>(std::clamp<int>(in[i], 0, 127));
+#endif
+    }
+    
+    // Sum of input[i] * weights[i]; inputs are in [0, 127] so the pairwise
+    // 16-bit products cannot saturate.
+    inline int32_t dot(const uint8_t* input, const int8_t* weights, int n) {
+#if defined(USE_AVX2)
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i sum = _mm256_setzero_si256();
+        for (int i = 0; i < n; i += 32) {
+            __m256i x = _mm256_load_si256(reinterpret_cast<const __m256i*>(input + i));
+            __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+            sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(x, w), ones));
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+        return _mm_cvtsi128_si32(s);
+#elif defined(USE_SSSE3)
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i sum = _mm_setzero_si128();
+        for (int i = 0; i < n; i += 16) {
+            __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(input + i));
+            __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(x, w), ones));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        return _mm_cvtsi128_si32(sum);
+#else
+        int32_t sum = 0;
+        for (int i = 0; i < n; ++i) sum += input[i] * weights[i];
+        return sum;
+#endif
+    }
+    
+    inline int evaluate(const Accumulator& acc, Color sideToMove) {
+        alignas(64) uint8_t input[2 * HALF_DIMS];
+        clip(acc.values[static_cast<int>(sideToMove)], input);
+        clip(acc.values[1 - static_cast<int>(sideToMove)], input + HALF_DIMS);
+        
+        int32_t output = active->outBias;
+        for (int j = 0; j < L1; ++j) {
+            int32_t sum = active->l1Bias[j] + dot(input, &active->l1Weights[j * 2 * HALF_DIMS], 2 * HALF_DIMS);
+            output += std::clamp(sum >> WEIGHT_SHIFT, 0, 127) * active->outWeights[j];
+        }
+        return output / OUTPUT_SCALE;
+    }
+    
+    // File layout: magic, HALF_DIMS and L1 as uint32, then every array of
+    // Network in declaration order, little-endian.
+    inline bool load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+        
+        uint32_t header[3];
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!file || header[0] != MAGIC || header[1] != HALF_DIMS || header[2] != L1) return false;
+        
+        auto net = std::make_unique<Network>();
+        file.read(reinterpret_cast<char*>(net->ftBias), sizeof(net->ftBias));
+        file.read(reinterpret_cast<char*>(net->ftWeights), sizeof(net->ftWeights));
+        file.read(reinterpret_cast<char*>(net->l1Bias), sizeof(net->l1Bias));
+        file.read(reinterpret_cast<char*>(net->l1Weights), sizeof(net->l1Weights));
+        file.read(reinterpret_cast<char*>(net->outWeights), sizeof(net->outWeights));
+        file.read(reinterpret_cast<char*>(&net->outBias), sizeof(net->outBias));
+        if (!file) return false;
+        
+        network = std::move(net);
+        std::cerr << "info string NNUE loaded: " << path << std::endl;
+        return true;
+    }
+    
+    // Seeded random weights, for testing the inference and update paths
+    // without a trained net.
+    inline void randomize(uint64_t seed) {
+        auto net = std::make_unique<Network>();
+        std::mt19937_64 rng(seed);
+        auto uniform = [&rng](int range) { return static_cast<int>(rng() % (2 * range + 1)) - range; };
+        for (auto& w : net->ftBias) w = static_cast<int16_t>(uniform(32));
+        for (auto& w : net->ftWeights) w = static_cast<int16_t>(uniform(8));
+        for (auto& w : net->l1Bias) w = uniform(1024);
+        for (auto& w : net->l1Weights) w = static_cast<int8_t>(uniform(32));
+        for (auto& w : net->outWeights) w = static_cast<int8_t>(uniform(32));
+        net->outBias = 0;
+        network = std::move(net);
+    }
+}
+
 // Board Class
 class Board {
 private:
     std::array<uint64_t, 6> pieces_[2];
+    std::array<Piece, 64> board_;
+    uint64_t colors_[2] = {0, 0};
     uint64_t occupied_ = 0;
-    uint64_t empty_ = ~0ULL;
     Color sideToMove_ = Color::WHITE;
     Square enPassant_ = Square::NONE;
-    bool castlingRights_[2][2] = {{true, true}, {true, true}};
+    uint8_t castling_ = 0xF;  // 1 = K, 2 = Q, 4 = k, 8 = q
     int halfmoveClock_ = 0;
+    int pliesFromNull_ = 0;  // repetitions cannot reach back past a null move
     int fullmoveNumber_ = 1;
-    std::vector<Move> moveStack_;
-    std::vector<BoardState> stateStack_;
-	std::vector<uint64_t> positionHistory_;
-    
+    uint64_t hash_ = 0;
+    uint64_t pawnKey_ = 0;  // Zobrist key of the pawns alone
+    
+    // White-relative material + PST sums and the material signature, kept up
+    // to date by putPiece/removePiece/movePiece.
+    int mg_ = 0;
+    int eg_ = 0;
+    uint64_t materialKey_ = 0;
+    
+    Nnue::Accumulator accumulator_;  // only maintained while Nnue::active is set
+    
+    std::array<UndoInfo, MAX_GAME_PLY> undo_;
+    int ply_ = 0;
+    
+    // Castling rights lost when a piece moves from or to each square.
+    static constexpr std::array<uint8_t, 64> CASTLING_SPOILERS = [] {
+        std::array<uint8_t, 64> spoilers{};
+        spoilers[0] = 2; spoilers[4] = 3; spoilers[7] = 1;
+        spoilers[56] = 8; spoilers[60] = 12; spoilers[63] = 4;
+        return spoilers;
+    }();
+    
+    // Only reached in very long games: keep the most recent records, which
+    // cover both the moves still to be unmade and the window repetition
+    // detection looks at, and drop the rest.
+    void compactHistory() {
+        std::copy(undo_.begin() + MAX_GAME_PLY - MAX_PLY, undo_.begin() + MAX_GAME_PLY, undo_.begin());
+        ply_ = MAX_PLY;
+    }
+    
+    // Rebuilds the mailbox and occupancy from the piece bitboards. Only used
+    // when a position is set up; make/unmake keep everything in sync.
     inline void updateBitboards() {
-        occupied_ = 0;
+        board_.fill(NO_PIECE);
         for (int c = 0; c < 2; ++c) {
-            for (int p = 0; p < 6; ++p) occupied_ |= pieces_[c][p];
+            colors_[c] = 0;
+            for (int p = 0; p < 6; ++p) {
+                colors_[c] |= pieces_[c][p];
+                uint64_t bb = pieces_[c][p];
+                while (bb) {
+                    board_[lsbIndex(bb)] = {static_cast<PieceType>(p), static_cast<Color>(c)};
+                    bb &= bb - 1;
+                }
+            }
         }
-        empty_ = ~occupied_;
+        occupied_ = colors_[0] | colors_[1];
+        
+        mg_ = eg_ = 0;
+        materialKey_ = 0;
+        for (int sq = 0; sq < 64; ++sq) {
+            if (board_[sq].type == PieceType::NONE) continue;
+            int c = static_cast<int>(board_[sq].color), p = static_cast<int>(board_[sq].type);
+            mg_ += Pst::MG[c][p][sq];
+            eg_ += Pst::EG[c][p][sq];
+            materialKey_ += materialBit(c, p);
+        }
+        refreshAccumulators();
+    }
+    
+    template <bool Add>
+    inline void updateAccumulator(int sq, Piece piece) {
+        if (piece.type == PieceType::KING) return;
+        for (int c = 0; c < 2; ++c) {
+            if (!pieces_[c][5]) continue;
+            int feature = Nnue::featureIndex(static_cast<Color>(c), lsbIndex(pieces_[c][5]), piece, sq);
+            Nnue::update<Add>(accumulator_.values[c], feature);
+        }
+    }
+    
+    // A king move changes every feature of its own side, so that half is
+    // rebuilt from scratch.
+    void refreshAccumulator(Color perspective) {
+        int c = static_cast<int>(perspective);
+        std::copy(std::begin(Nnue::active->ftBias), std::end(Nnue::active->ftBias), accumulator_.values[c]);
+        if (!pieces_[c][5]) return;
+        int kingSq = lsbIndex(pieces_[c][5]);
+        for (uint64_t bb = occupied_ & ~(pieces_[0][5] | pieces_[1][5]); bb; bb &= bb - 1) {
+            int sq = lsbIndex(bb);
+            Nnue::update<true>(accumulator_.values[c], Nnue::featureIndex(perspective, kingSq, board_[sq], sq));
+        }
+    }
+    
+    inline void putPiece(int sq, Piece piece) {
+        int c = static_cast<int>(piece.color), p = static_cast<int>(piece.type);
+        uint64_t mask = 1ULL << sq;
+        pieces_[c][p] |= mask;
+        colors_[c] |= mask;
+        occupied_ |= mask;
+        board_[sq] = piece;
+        if (Nnue::active) updateAccumulator<true>(sq, piece);
+        mg_ += Pst::MG[c][p][sq];
+        eg_ += Pst::EG[c][p][sq];
+        materialKey_ += materialBit(c, p);
+    }
+    
+    inline void removePiece(int sq) {
+        Piece piece = board_[sq];
+        int c = static_cast<int>(piece.color), p = static_cast<int>(piece.type);
+        uint64_t mask = 1ULL << sq;
+        pieces_[c][p] ^= mask;
+        colors_[c] ^= mask;
+        occupied_ ^= mask;
+        board_[sq] = NO_PIECE;
+        if (Nnue::active) updateAccumulator<false>(sq, piece);
+        mg_ -= Pst::MG[c][p][sq];
+        eg_ -= Pst::EG[c][p][sq];
+        materialKey_ -= materialBit(c, p);
+    }
+    
+    inline void movePiece(int from, int to) {
+        Piece piece = board_[from];
+        int c = static_cast<int>(piece.color), p = static_cast<int>(piece.type);
+        uint64_t mask = (1ULL << from) | (1ULL << to);
+        pieces_[c][p] ^= mask;
+        colors_[c] ^= mask;
+        occupied_ ^= mask;
+        board_[to] = piece;
+        board_[from] = NO_PIECE;
+        if (Nnue::active) {
+            updateAccumulator<false>(from, piece);
+            updateAccumulator<true>(to, piece);
+        }
+        mg_ += Pst::MG[c][p][to] - Pst::MG[c][p][from];
+        eg_ += Pst::EG[c][p][to] - Pst::EG[c][p][from];
     }
     
     inline bool isSquareAttacked(Square sq, Color attacker) const {
-        uint64_t occ = occupied_;
-        int s = static_cast<int>(sq);
-
-        uint64_t attackerPawns = pieces_[static_cast<int>(attacker)][0];
-        if (attacker == Color::WHITE) {
-            uint64_t leftAttacks = (attackerPawns << 7) & ~0x8080808080808080ULL;
-            uint64_t rightAttacks = (attackerPawns << 9) & ~0x0101010101010101ULL;
-            if ((leftAttacks | rightAttacks) & (1ULL << s)) return true;
-        } else {
-            uint64_t leftAttacks = (attackerPawns >> 9) & ~0x8080808080808080ULL;
-            uint64_t rightAttacks = (attackerPawns >> 7) & ~0x0101010101010101ULL;
-            if ((leftAttacks | rightAttacks) & (1ULL << s)) return true;
-        }
-        
-        uint64_t knights = pieces_[static_cast<int>(attacker)][1];
-        while (knights) {
-            int ksq = lsbIndex(knights);
-            if (Attacks::knightAttacks(static_cast<Square>(ksq)) & (1ULL << s)) return true;
-            knights &= knights - 1;
-        }
-        
-        uint64_t bishops = pieces_[static_cast<int>(attacker)][2];
-        while (bishops) {
-            int bsq = lsbIndex(bishops);
-            if (Attacks::bishopAttacks(static_cast<Square>(bsq), occ) & (1ULL << s)) return true;
-            bishops &= bishops - 1;
-        }
-        
-        uint64_t rooks = pieces_[static_cast<int>(attacker)][3];
-        while (rooks) {
-            int rsq = lsbIndex(rooks);
-            if (Attacks::rookAttacks(static_cast<Square>(rsq), occ) & (1ULL << s)) return true;
-            rooks &= rooks - 1;
-        }
-        
-        uint64_t queens = pieces_[static_cast<int>(attacker)][4];
-        while (queens) {
-            int qsq = lsbIndex(queens);
-            if (Attacks::queenAttacks(static_cast<Square>(qsq), occ) & (1ULL << s)) return true;
-            queens &= queens - 1;
-        }
+        return isSquareAttackedBy(sq, attacker, occupied_);
+    }
+    
+    inline bool isSquareAttackedBy(Square sq, Color attacker, uint64_t occupied) const {
+        const auto& their = pieces_[static_cast<int>(attacker)];
+        Color defender = (attacker == Color::WHITE) ? Color::BLACK : Color::WHITE;
         
-        uint64_t kings = pieces_[static_cast<int>(attacker)][5];
-        if (kings) {
-            int ksq = lsbIndex(kings);
-            if (Attacks::kingAttacks(static_cast<Square>(ksq)) & (1ULL << s)) return true;
-        }
+        if (Attacks::pawnAttacks(defender, sq) & their[0]) return true;
+        if (Attacks::knightAttacks(sq) & their[1]) return true;
+        if (Attacks::kingAttacks(sq) & their[5]) return true;
+        if (Attacks::bishopAttacks(sq, occupied) & (their[2] | their[4])) return true;
+        if (Attacks::rookAttacks(sq, occupied) & (their[3] | their[4])) return true;
         
         return false;
     }
-	
-    inline uint64_t squaresBetween(int sq1, int sq2) const {
-        if (sq1 == sq2) return 0;
-        
-        int r1 = sq1 / 8, f1 = sq1 % 8;
-        int r2 = sq2 / 8, f2 = sq2 % 8;
+    
+    inline uint64_t attackersOf(int sq, Color attacker, uint64_t occupied) const {
+        const auto& their = pieces_[static_cast<int>(attacker)];
+        Color defender = (attacker == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        Square s = static_cast<Square>(sq);
         
-        int dr = (r2 > r1) ? 1 : (r2 < r1) ? -1 : 0;
-        int df = (f2 > f1) ? 1 : (f2 < f1) ? -1 : 0;
+        return (Attacks::pawnAttacks(defender, s) & their[0]) |
+               (Attacks::knightAttacks(s) & their[1]) |
+               (Attacks::kingAttacks(s) & their[5]) |
+               (Attacks::bishopAttacks(s, occupied) & (their[2] | their[4])) |
+               (Attacks::rookAttacks(s, occupied) & (their[3] | their[4]));
+    }
+    
+    uint64_t computePins(Color us, int kingSq) const {
+        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        const auto& their = pieces_[static_cast<int>(them)];
         
-        if (dr == 0 && df == 0) return 0;
-        if (dr != 0 && df != 0 && std::abs(r2 - r1) != std::abs(f2 - f1)) return 0;
+        uint64_t ourPieces = colors_[static_cast<int>(us)];
         
-        uint64_t between = 0;
-        int r = r1 + dr, f = f1 + df;
+        uint64_t snipers = (Attacks::bishopAttacks(static_cast<Square>(kingSq), 0) & (their[2] | their[4])) |
+                           (Attacks::rookAttacks(static_cast<Square>(kingSq), 0) & (their[3] | their[4]));
+        uint64_t pinned = 0;
         
-        while (r != r2 || f != f2) {
-            between |= (1ULL << (r * 8 + f));
-            r += dr;
-            f += df;
+        while (snipers) {
+            int pinnerSq = lsbIndex(snipers);
+            snipers &= snipers - 1;
+            
+            uint64_t blockers = Attacks::BETWEEN[kingSq][pinnerSq] & occupied_;
+            if (::popcount(blockers) == 1 && (blockers & ourPieces)) {
+                pinned |= blockers;
+            }
         }
         
-        return between;
+        return pinned;
     }
-    
-    inline bool isSquareAttackedBy(Square sq, Color attacker, uint64_t occupied) const {
-        int s = static_cast<int>(sq);
-
-        uint64_t attackerPawns = pieces_[static_cast<int>(attacker)][0];
-        if (attacker == Color::WHITE) {
-            uint64_t leftAttacks = (attackerPawns << 7) & ~0x8080808080808080ULL;
-            uint64_t rightAttacks = (attackerPawns << 9) & ~0x0101010101010101ULL;
-            if ((leftAttacks | rightAttacks) & (1ULL << s)) return true;
-        } else {
-            uint64_t leftAttacks = (attackerPawns >> 9) & ~0x8080808080808080ULL;
-            uint64_t rightAttacks = (attackerPawns >> 7) & ~0x0101010101010101ULL;
-            if ((leftAttacks | rightAttacks) & (1ULL << s)) return true;
-        }
 
-        uint64_t knights = pieces_[static_cast<int>(attacker)][1];
-        while (knights) {
-            int ksq = lsbIndex(knights);
-            if (Attacks::knightAttacks(static_cast<Square>(ksq)) & (1ULL << s)) return true;
-            knights &= knights - 1;
-        }
+    bool isEnPassantLegal(Square from, Square to, Color us) const {
+        uint64_t kings = pieces_[static_cast<int>(us)][5];
+        if (!kings) return false;
+        
+        int kingSq = lsbIndex(kings);
+        int capturedPawnSq = (us == Color::WHITE) ? static_cast<int>(to) - 8 : static_cast<int>(to) + 8;
 
-        uint64_t bishops = pieces_[static_cast<int>(attacker)][2] | pieces_[static_cast<int>(attacker)][4];
-        while (bishops) {
-            int bsq = lsbIndex(bishops);
-            if (Attacks::bishopAttacks(static_cast<Square>(bsq), occupied) & (1ULL << s)) return true;
-            bishops &= bishops - 1;
-        }
+        uint64_t newOccupied = occupied_;
+        newOccupied &= ~(1ULL << static_cast<int>(from));
+        newOccupied &= ~(1ULL << capturedPawnSq);
+        newOccupied |= (1ULL << static_cast<int>(to));
 
-        uint64_t rooks = pieces_[static_cast<int>(attacker)][3] | pieces_[static_cast<int>(attacker)][4];
-        while (rooks) {
-            int rsq = lsbIndex(rooks);
-            if (Attacks::rookAttacks(static_cast<Square>(rsq), occupied) & (1ULL << s)) return true;
-            rooks &= rooks - 1;
-        }
+        // Only sliders can be uncovered by an en passant capture; every other
+        // check is already filtered through blockCaptureSquares.
+        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        const auto& their = pieces_[static_cast<int>(them)];
+        return !(Attacks::bishopAttacks(static_cast<Square>(kingSq), newOccupied) & (their[2] | their[4])) &&
+               !(Attacks::rookAttacks(static_cast<Square>(kingSq), newOccupied) & (their[3] | their[4]));
+    }
 
-        uint64_t kings = pieces_[static_cast<int>(attacker)][5];
-        if (kings) {
-            int ksq = lsbIndex(kings);
-            if (Attacks::kingAttacks(static_cast<Square>(ksq)) & (1ULL << s)) return true;
+    inline void addPromotions(MoveList& moves, int from, int to, bool queen, bool under) const {
+        PieceType captured = board_[to].type;
+        if (queen) moves.emplace_back(from, to, PieceType::PAWN, captured, PieceType::QUEEN);
+        if (under) {
+            moves.emplace_back(from, to, PieceType::PAWN, captured, PieceType::KNIGHT);
+            moves.emplace_back(from, to, PieceType::PAWN, captured, PieceType::BISHOP);
+            moves.emplace_back(from, to, PieceType::PAWN, captured, PieceType::ROOK);
         }
-        
-        return false;
     }
-
-    struct PinInfo {
-        uint64_t pinned;
-        uint64_t pinRays[64];
-        
-        PinInfo() : pinned(0) {
-            for (int i = 0; i < 64; ++i) pinRays[i] = 0;
+    
+    inline void addPieceMoves(MoveList& moves, int from, PieceType moved, uint64_t targets) const {
+        uint64_t captures = targets & occupied_;
+        while (captures) {
+            int to = lsbIndex(captures);
+            moves.emplace_back(from, to, moved, board_[to].type);
+            captures &= captures - 1;
         }
-    };
+        uint64_t quiets = targets & ~occupied_;
+        while (quiets) {
+            moves.emplace_back(from, lsbIndex(quiets), moved);
+            quiets &= quiets - 1;
+        }
+    }
     
-    PinInfo computePins(Color us) const {
-        PinInfo info;
+    // Legal move generation shared by all modes. CAPTURES yields captures,
+    // en passant and queen promotions; QUIETS yields the rest (including
+    // underpromotions and castling); EVASIONS and LEGAL yield every legal move.
+    template <GenType Type>
+    void generate(MoveList& moves, const AttackInfo& info) const {
+        constexpr bool CAPS = Type != GenType::QUIETS;
+        constexpr bool QUIET = Type != GenType::CAPTURES;
         
-        uint64_t kings = pieces_[static_cast<int>(us)][5];
-        if (!kings) return info;
-        
-        int kingSq = lsbIndex(kings);
+        Color us = sideToMove_;
         Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        const auto& ours = pieces_[static_cast<int>(us)];
+        uint64_t occ = occupied_;
         
-        uint64_t ourPieces = 0;
-        for (int p = 0; p < 6; ++p) ourPieces |= pieces_[static_cast<int>(us)][p];
+        uint64_t ourPieces = colors_[static_cast<int>(us)];
+        uint64_t enemy = colors_[static_cast<int>(them)];
 
-        uint64_t enemyBishops = pieces_[static_cast<int>(them)][2] | pieces_[static_cast<int>(them)][4];
-        uint64_t bishopAttacks = Attacks::bishopAttacks(static_cast<Square>(kingSq), 0);
-        uint64_t potentialPinners = enemyBishops & bishopAttacks;
-        
-        while (potentialPinners) {
-            int pinnerSq = lsbIndex(potentialPinners);
-            potentialPinners &= potentialPinners - 1;
+        if (!ours[5]) return;
+        int kingSq = lsbIndex(ours[5]);
 
-            uint64_t between = squaresBetween(kingSq, pinnerSq);
-            uint64_t blockers = between & occupied_;
+        uint64_t pinned = info.pinned;
+        uint64_t checkers = info.checkers;
+        bool inCheck = checkers != 0;
+        
+        uint64_t target = (Type == GenType::CAPTURES) ? enemy :
+                          (Type == GenType::QUIETS) ? ~occ : ~ourPieces;
+        
+        uint64_t blockCaptureSquares = ~0ULL;
+        if (inCheck) {
+            blockCaptureSquares = checkers | Attacks::BETWEEN[kingSq][lsbIndex(checkers)];
+        }
 
-            if (::popcount(blockers) == 1) {
-                int pinnedSq = lsbIndex(blockers);
-                if (ourPieces & (1ULL << pinnedSq)) {
-                    info.pinned |= (1ULL << pinnedSq);
-                    info.pinRays[pinnedSq] = between | (1ULL << pinnerSq);
+        if (::popcount(checkers) <= 1) {
+            int up = (us == Color::WHITE) ? 8 : -8;
+            uint64_t promoRank = (us == Color::WHITE) ? 0xFF00000000000000ULL : 0x00000000000000FFULL;
+            uint64_t pushRank = (us == Color::WHITE) ? 0x0000000000FF0000ULL : 0x0000FF0000000000ULL;
+            
+            uint64_t pawns = ours[0];
+            while (pawns) {
+                int from = lsbIndex(pawns);
+                pawns &= pawns - 1;
+                
+                uint64_t legalSquares = (pinned & (1ULL << from)) ? Attacks::LINE[kingSq][from] : ~0ULL;
+                legalSquares &= blockCaptureSquares;
+                
+                int to = from + up;
+                if (~occ & (1ULL << to)) {
+                    if (legalSquares & (1ULL << to)) {
+                        if (promoRank & (1ULL << to)) addPromotions(moves, from, to, CAPS, QUIET);
+                        else if (QUIET) moves.emplace_back(from, to, PieceType::PAWN);
+                    }
+                    if (QUIET && (pushRank & (1ULL << to)) && (~occ & legalSquares & (1ULL << (to + up)))) {
+                        moves.emplace_back(from, to + up, PieceType::PAWN);
+                    }
+                }
+                
+                uint64_t attacks = Attacks::pawnAttacks(us, static_cast<Square>(from));
+                uint64_t captures = attacks & enemy & legalSquares;
+                while (captures) {
+                    int capTo = lsbIndex(captures);
+                    captures &= captures - 1;
+                    if (promoRank & (1ULL << capTo)) addPromotions(moves, from, capTo, CAPS, QUIET);
+                    else if (CAPS) moves.emplace_back(from, capTo, PieceType::PAWN, board_[capTo].type);
+                }
+                
+                if (CAPS && enPassant_ != Square::NONE && (attacks & (1ULL << static_cast<int>(enPassant_)))) {
+                    int epTo = static_cast<int>(enPassant_);
+                    uint64_t capturedPawn = 1ULL << (epTo - up);
+                    if ((blockCaptureSquares & ((1ULL << epTo) | capturedPawn)) &&
+                        isEnPassantLegal(static_cast<Square>(from), enPassant_, us)) {
+                        moves.emplace_back(from, epTo, PieceType::PAWN, PieceType::PAWN, PieceType::NONE, Move::EN_PASSANT);
+                    }
                 }
             }
-        }
-
-        uint64_t enemyRooks = pieces_[static_cast<int>(them)][3] | pieces_[static_cast<int>(them)][4];
-        uint64_t rookAttacks = Attacks::rookAttacks(static_cast<Square>(kingSq), 0);
-        potentialPinners = enemyRooks & rookAttacks;
-        
-        while (potentialPinners) {
-            int pinnerSq = lsbIndex(potentialPinners);
-            potentialPinners &= potentialPinners - 1;
-
-            uint64_t between = squaresBetween(kingSq, pinnerSq);
-            uint64_t blockers = between & occupied_;
+            
+            uint64_t pieceTarget = target & blockCaptureSquares;
+            
+            uint64_t knights = ours[1] & ~pinned;
+            while (knights) {
+                int from = lsbIndex(knights);
+                knights &= knights - 1;
+                
+                addPieceMoves(moves, from, PieceType::KNIGHT, Attacks::knightAttacks(static_cast<Square>(from)) & pieceTarget);
+            }
 
-            if (::popcount(blockers) == 1) {
-                int pinnedSq = lsbIndex(blockers);
-                if (ourPieces & (1ULL << pinnedSq)) {
-                    info.pinned |= (1ULL << pinnedSq);
-                    info.pinRays[pinnedSq] = between | (1ULL << pinnerSq);
-                }
+            uint64_t sliders = ours[2] | ours[3] | ours[4];
+            while (sliders) {
+                int from = lsbIndex(sliders);
+                sliders &= sliders - 1;
+                
+                uint64_t attacks = 0;
+                if ((ours[2] | ours[4]) & (1ULL << from)) attacks |= Attacks::bishopAttacks(static_cast<Square>(from), occ);
+                if ((ours[3] | ours[4]) & (1ULL << from)) attacks |= Attacks::rookAttacks(static_cast<Square>(from), occ);
+                attacks &= pieceTarget;
+                if (pinned & (1ULL << from)) attacks &= Attacks::LINE[kingSq][from];
+                
+                addPieceMoves(moves, from, board_[from].type, attacks);
             }
         }
         
-        return info;
-    }
+        uint64_t kingTargets = Attacks::kingAttacks(static_cast<Square>(kingSq)) & target;
+        while (kingTargets) {
+            int to = lsbIndex(kingTargets);
+            kingTargets &= kingTargets - 1;
 
-    bool isEnPassantLegal(Square from, Square to, Color us) const {
-        uint64_t kings = pieces_[static_cast<int>(us)][5];
-        if (!kings) return false;
+            uint64_t newOccupied = (occ & ~(1ULL << kingSq)) | (1ULL << to);
+            if (!isSquareAttackedBy(static_cast<Square>(to), them, newOccupied)) {
+                moves.emplace_back(kingSq, to, PieceType::KING, board_[to].type);
+            }
+        }
         
-        int kingSq = lsbIndex(kings);
-        int capturedPawnSq = (us == Color::WHITE) ? static_cast<int>(to) - 8 : static_cast<int>(to) + 8;
+        if (QUIET && !inCheck) {
+            int backRank = (us == Color::WHITE) ? 0 : 56;
 
-        uint64_t newOccupied = occupied_;
-        newOccupied &= ~(1ULL << static_cast<int>(from));
-        newOccupied &= ~(1ULL << capturedPawnSq);
-        newOccupied |= (1ULL << static_cast<int>(to));
+            if ((castling_ & (us == Color::WHITE ? 1 : 4)) && kingSq == backRank + 4) {
+                int f1 = backRank + 5;
+                int g1 = backRank + 6;
+                int h1 = backRank + 7;
+                
+                if (!(occ & ((1ULL << f1) | (1ULL << g1))) &&
+                    (ours[3] & (1ULL << h1)) &&
+                    !isSquareAttackedBy(static_cast<Square>(f1), them, occ) &&
+                    !isSquareAttackedBy(static_cast<Square>(g1), them, occ)) {
+                    moves.emplace_back(kingSq, g1, PieceType::KING, PieceType::NONE, PieceType::NONE, Move::CASTLING);
+                }
+            }
 
-        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        return !isSquareAttackedBy(static_cast<Square>(kingSq), them, newOccupied);
+            if ((castling_ & (us == Color::WHITE ? 2 : 8)) && kingSq == backRank + 4) {
+                int a1 = backRank;
+                int b1 = backRank + 1;
+                int c1 = backRank + 2;
+                int d1 = backRank + 3;
+                
+                if (!(occ & ((1ULL << b1) | (1ULL << c1) | (1ULL << d1))) &&
+                    (ours[3] & (1ULL << a1)) &&
+                    !isSquareAttackedBy(static_cast<Square>(c1), them, occ) &&
+                    !isSquareAttackedBy(static_cast<Square>(d1), them, occ)) {
+                    moves.emplace_back(kingSq, c1, PieceType::KING, PieceType::NONE, PieceType::NONE, Move::CASTLING);
+                }
+            }
+        }
     }
 
 public:
     Board() {
         for (int c = 0; c < 2; ++c) {
             for (int p = 0; p < 6; ++p) pieces_[c][p] = 0;
-            castlingRights_[c][0] = true;
-            castlingRights_[c][1] = true;
         }
         reset();
     }
@@ -446,14 +1188,13 @@ public:
         updateBitboards();
         sideToMove_ = Color::WHITE;
         enPassant_ = Square::NONE;
-        castlingRights_[0][0] = castlingRights_[0][1] = true;
-        castlingRights_[1][0] = castlingRights_[1][1] = true;
+        castling_ = 0xF;
         halfmoveClock_ = 0;
+        pliesFromNull_ = 0;
         fullmoveNumber_ = 1;
-        moveStack_.clear();
-        stateStack_.clear();
-		positionHistory_.clear();
-		positionHistory_.push_back(computeHash());
+        ply_ = 0;
+		hash_ = computeHash();
+		pawnKey_ = computePawnKey();
     }
     
     void setFen(const std::string& fen) {
@@ -493,13 +1234,12 @@ public:
         updateBitboards();
         sideToMove_ = (colorPart == "w") ? Color::WHITE : Color::BLACK;
         
-        castlingRights_[0][0] = castlingRights_[0][1] = false;
-        castlingRights_[1][0] = castlingRights_[1][1] = false;
+        castling_ = 0;
         for (char ch : castlingPart) {
-            if (ch == 'K') castlingRights_[0][0] = true;
-            else if (ch == 'Q') castlingRights_[0][1] = true;
-            else if (ch == 'k') castlingRights_[1][0] = true;
-            else if (ch == 'q') castlingRights_[1][1] = true;
+            if (ch == 'K') castling_ |= 1;
+            else if (ch == 'Q') castling_ |= 2;
+            else if (ch == 'k') castling_ |= 4;
+            else if (ch == 'q') castling_ |= 8;
         }
         
         if (epPart != "-") {
@@ -510,110 +1250,150 @@ public:
         
         iss >> halfmoveClock_ >> fullmoveNumber_;
 		
-		positionHistory_.clear();
-		positionHistory_.push_back(computeHash());
+		ply_ = 0;
+		hash_ = computeHash();
+		pawnKey_ = computePawnKey();
     }
     
     Color turn() const { return sideToMove_; }
     Square enPassant() const { return enPassant_; }
     uint64_t occupied() const { return occupied_; }
+    uint64_t occupied(Color color) const { return colors_[static_cast<int>(color)]; }
     
     uint64_t getBitboard(PieceType type, Color color) const {
         return pieces_[static_cast<int>(color)][static_cast<int>(type)];
     }
     
+    // Full Zobrist recomputation; make/unmake maintain hash_ incrementally.
     uint64_t computeHash() const {
-        uint64_t hash = 0x9e3779b97f4a7c15ULL;
+        uint64_t hash = 0;
         for (int c = 0; c < 2; ++c) {
             for (int p = 0; p < 6; ++p) {
                 uint64_t bb = pieces_[c][p];
                 while (bb) {
-                    int sq = lsbIndex(bb);
-                    hash ^= (c * 6ULL + p + 1) * 0x123456789abcdef0ULL ^ (sq * 0xbf58476d1ce4e5b9ULL);
+                    hash ^= Zobrist::PIECES[c][p][lsbIndex(bb)];
                     bb &= bb - 1;
                 }
             }
         }
-        hash ^= static_cast<uint64_t>(sideToMove_) * 0xabcdef0123456789ULL;
+        hash ^= Zobrist::CASTLING[castling_];
+        if (enPassant_ != Square::NONE) hash ^= Zobrist::EN_PASSANT[static_cast<int>(enPassant_) % 8];
+        if (sideToMove_ == Color::BLACK) hash ^= Zobrist::SIDE;
         return hash;
     }
     
-    Piece pieceAt(Square sq) const {
-        if (sq == Square::NONE) return {PieceType::NONE, Color::NONE};
-        uint64_t mask = 1ULL << static_cast<int>(sq);
+    uint64_t computePawnKey() const {
+        uint64_t key = 0;
         for (int c = 0; c < 2; ++c) {
-            for (int p = 0; p < 6; ++p) {
-                if (pieces_[c][p] & mask) {
-                    return {static_cast<PieceType>(p), static_cast<Color>(c)};
-                }
+            uint64_t bb = pieces_[c][0];
+            while (bb) {
+                key ^= Zobrist::PIECES[c][0][lsbIndex(bb)];
+                bb &= bb - 1;
             }
         }
-        return {PieceType::NONE, Color::NONE};
+        return key;
+    }
+    
+    uint64_t hash() const { return hash_; }
+    uint64_t pawnKey() const { return pawnKey_; }
+    int mgScore() const { return mg_; }
+    int egScore() const { return eg_; }
+    uint64_t materialKey() const { return materialKey_; }
+    
+    const Nnue::Accumulator& accumulator() const { return accumulator_; }
+    
+    void refreshAccumulators() {
+        if (!Nnue::active) return;
+        refreshAccumulator(Color::WHITE);
+        refreshAccumulator(Color::BLACK);
+    }
+    
+    // The material key packs a 4-bit count for every non-king piece of
+    // both colors, so it identifies the material configuration exactly.
+    static constexpr uint64_t materialBit(int color, int piece) {
+        return piece == 5 ? 0 : 1ULL << (4 * (5 * color + piece));
+    }
+    
+    Piece pieceAt(Square sq) const {
+        if (sq == Square::NONE) return NO_PIECE;
+        return board_[static_cast<int>(sq)];
     }
 	
-	int repetitionCount() const {
-		uint64_t currentHash = computeHash();
+	// Only positions an even number of plies back, and no further back than
+	// the last capture, pawn move or null move, can equal the current one.
+	// One earlier occurrence is enough inside the search (less than
+	// searchPly plies back), since the same moves could be repeated again;
+	// at or before the root it takes two, the threefold rule.
+	bool isRepetition(int searchPly) const {
 		int count = 0;
-		for (int i = positionHistory_.size() - 1; i >= 0; --i) {
-			if (positionHistory_[i] == currentHash) {
-				++count;
+		int end = std::min({halfmoveClock_, pliesFromNull_, ply_});
+		for (int i = 4; i <= end; i += 2) {
+			if (undo_[ply_ - i].hash == hash_ && (i < searchPly || ++count == 2)) return true;
+		}
+		return false;
+	}
+	
+	// True if the side to move has a reversible move back into a position
+	// reached earlier in the search (less than searchPly plies ago). The hash
+	// difference to that position must then be exactly one move's worth,
+	// which the cuckoo table recognises in two probes; the path between the
+	// two squares must be clear and the piece must be ours. Pins are ignored.
+	bool hasUpcomingRepetition(int searchPly) const {
+		int end = std::min({halfmoveClock_, pliesFromNull_, ply_, searchPly - 1});
+		for (int i = 3; i <= end; i += 2) {
+			uint64_t moveKey = hash_ ^ undo_[ply_ - i].hash;
+			int j = Zobrist::cuckooH1(moveKey);
+			if (Zobrist::CUCKOO_KEYS[j] != moveKey) {
+				j = Zobrist::cuckooH2(moveKey);
+				if (Zobrist::CUCKOO_KEYS[j] != moveKey) continue;
 			}
-			if (positionHistory_.size() - i > 100) break;
+			int s1 = Zobrist::CUCKOO_MOVES[j] & 0x3F, s2 = (Zobrist::CUCKOO_MOVES[j] >> 6) & 0x3F;
+			if (Attacks::BETWEEN[s1][s2] & occupied_) continue;
+			if (board_[(occupied_ >> s1) & 1 ? s1 : s2].color == sideToMove_) return true;
 		}
-		return count;
+		return false;
 	}
 
 	bool isDraw() const {
-		if (isStalemate()) return true;
+		return isStalemate() || isDrawByRule();
+	}
+	
+	// Draws that do not depend on the legal moves. The search finds
+	// stalemate (and mate) from its own move loop instead. searchPly is the
+	// distance from the search root, 0 outside a search.
+	bool isDrawByRule(int searchPly = 0) const {
 		if (isInsufficientMaterial()) return true;
 		if (halfmoveClock_ >= 100) return true;
-		if (repetitionCount() >= 3) return true;
+		if (isRepetition(searchPly)) return true;
 		return false;
 	}
     
-    bool isCapture(const Move& move) const {
-        return pieceAt(move.to).type != PieceType::NONE || 
-               (pieceAt(move.from).type == PieceType::PAWN && move.to == enPassant_);
-    }
-    
     bool isCheckmate() const {
-        return isInCheck(sideToMove_) && generateMoves().empty();
+        AttackInfo info = computeAttackInfo();
+        return info.checkers && !hasAnyLegalMove(info);
     }
     
     bool isStalemate() const {
-        return !isInCheck(sideToMove_) && generateMoves().empty();
+        AttackInfo info = computeAttackInfo();
+        return !info.checkers && !hasAnyLegalMove(info);
     }
     
+    // Bare kings, a single minor piece, or one bishop each on the same color.
     bool isInsufficientMaterial() const {
-        if (__builtin_popcountll(occupied_) == 2) return true;
-        
-        uint64_t whitePieces = pieces_[0][0] | pieces_[0][1] | pieces_[0][2] | pieces_[0][3] | pieces_[0][4];
-        uint64_t blackPieces = pieces_[1][0] | pieces_[1][1] | pieces_[1][2] | pieces_[1][3] | pieces_[1][4];
-        
-        if (whitePieces == 0 && __builtin_popcountll(blackPieces) == 1) return true;
-        if (blackPieces == 0 && __builtin_popcountll(whitePieces) == 1) return true;
-        
-        uint64_t whiteKnights = pieces_[0][1];
-        uint64_t blackKnights = pieces_[1][1];
-        uint64_t whiteBishops = pieces_[0][2];
-        uint64_t blackBishops = pieces_[1][2];
-
-        if (whitePieces == whiteKnights && __builtin_popcountll(whiteKnights) == 1 && blackPieces == 0) return true;
-        if (blackPieces == blackKnights && __builtin_popcountll(blackKnights) == 1 && whitePieces == 0) return true;
-
-        if (whitePieces == whiteBishops && __builtin_popcountll(whiteBishops) == 1 && blackPieces == 0) return true;
-        if (blackPieces == blackBishops && __builtin_popcountll(blackBishops) == 1 && whitePieces == 0) return true;
-
-        if (whitePieces == whiteBishops && blackPieces == blackBishops &&
-            __builtin_popcountll(whiteBishops) == 1 && __builtin_popcountll(blackBishops) == 1) {
-            int whiteSq = lsbIndex(whiteBishops);
-            int blackSq = lsbIndex(blackBishops);
-            bool whiteDark = ((whiteSq / 8 + whiteSq % 8) % 2) == 0;
-            bool blackDark = ((blackSq / 8 + blackSq % 8) % 2) == 0;
-            return whiteDark == blackDark;
+        switch (materialKey_) {
+            case 0:
+            case materialBit(0, 1):
+            case materialBit(0, 2):
+            case materialBit(1, 1):
+            case materialBit(1, 2):
+                return true;
+            case materialBit(0, 2) + materialBit(1, 2): {
+                constexpr uint64_t DARK_SQUARES = 0xAA55AA55AA55AA55ULL;
+                return !(pieces_[0][2] & DARK_SQUARES) == !(pieces_[1][2] & DARK_SQUARES);
+            }
+            default:
+                return false;
         }
-        
-        return false;
     }
     
 	bool isGameOver() const {
@@ -621,492 +1401,379 @@ public:
 	}
     
     void makeMove(const Move& move) {
-        BoardState state;
-        memcpy(state.pieces, pieces_, sizeof(pieces_));
-        state.occupied = occupied_;
-        state.empty = empty_;
-        state.sideToMove = sideToMove_;
-        state.enPassant = enPassant_;
-        memcpy(state.castlingRights, castlingRights_, sizeof(castlingRights_));
-        state.halfmoveClock = halfmoveClock_;
-        state.fullmoveNumber = fullmoveNumber_;
-        stateStack_.push_back(state);
-
-        int from = static_cast<int>(move.from);
-        int to = static_cast<int>(move.to);
+        if (ply_ == MAX_GAME_PLY) compactHistory();
+        
+        int from = static_cast<int>(move.from());
+        int to = static_cast<int>(move.to());
         Color us = sideToMove_;
         Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        
-        Piece moved = pieceAt(move.from);
-        Piece captured = pieceAt(move.to);
-
-        if (captured.type == PieceType::ROOK) {
-            if (move.to == Square::A1) castlingRights_[0][1] = false;
-            else if (move.to == Square::H1) castlingRights_[0][0] = false;
-            else if (move.to == Square::A8) castlingRights_[1][1] = false;
-            else if (move.to == Square::H8) castlingRights_[1][0] = false;
-        }
-        
-        uint64_t fromMask = 1ULL << from;
-        uint64_t toMask = 1ULL << to;
-
-        for (int c = 0; c < 2; ++c) {
-            for (int p = 0; p < 6; ++p) {
-                pieces_[c][p] &= ~fromMask;
-                pieces_[c][p] &= ~toMask;
-            }
-        }
-
-        pieces_[static_cast<int>(us)][static_cast<int>(moved.type)] |= toMask;
-
-        if (moved.type == PieceType::PAWN && move.to == enPassant_ && captured.type == PieceType::NONE) {
-            int epPawn = (us == Color::WHITE) ? to - 8 : to + 8;
-            uint64_t epMask = 1ULL << epPawn;
-            for (int c = 0; c < 2; ++c) {
-                for (int p = 0; p < 6; ++p) {
-                    pieces_[c][p] &= ~epMask;
-                }
-            }
-        }
-
-        if (move.promotion != PieceType::NONE) {
-            pieces_[static_cast<int>(us)][static_cast<int>(moved.type)] &= ~toMask;
-            pieces_[static_cast<int>(us)][static_cast<int>(move.promotion)] |= toMask;
-        }
-
-        if (moved.type == PieceType::KING && std::abs(to - from) == 2) {
+        PieceType moved = move.moved();
+        PieceType captured = move.captured();
+        
+        UndoInfo& undo = undo_[ply_++];
+        undo.hash = hash_;
+        undo.pawnKey = pawnKey_;
+        undo.move = move;
+        undo.castling = castling_;
+        undo.enPassant = enPassant_;
+        undo.halfmoveClock = static_cast<int16_t>(halfmoveClock_);
+        undo.pliesFromNull = static_cast<int16_t>(pliesFromNull_);
+        
+        uint64_t key = hash_ ^ Zobrist::SIDE ^ Zobrist::CASTLING[castling_];
+        if (enPassant_ != Square::NONE) key ^= Zobrist::EN_PASSANT[static_cast<int>(enPassant_) % 8];
+        
+        if (move.isCapture()) {
+            int capturedSq = move.isEnPassant() ? ((us == Color::WHITE) ? to - 8 : to + 8) : to;
+            uint64_t capturedKey = Zobrist::PIECES[static_cast<int>(them)][static_cast<int>(captured)][capturedSq];
+            key ^= capturedKey;
+            if (captured == PieceType::PAWN) pawnKey_ ^= capturedKey;
+            removePiece(capturedSq);
+        }
+        
+        const auto& movedKeys = Zobrist::PIECES[static_cast<int>(us)][static_cast<int>(moved)];
+        key ^= movedKeys[from] ^ movedKeys[to];
+        if (moved == PieceType::PAWN) pawnKey_ ^= movedKeys[from] ^ movedKeys[to];
+        movePiece(from, to);
+
+        if (move.isPromotion()) {
+            key ^= movedKeys[to] ^ Zobrist::PIECES[static_cast<int>(us)][static_cast<int>(move.promotion())][to];
+            pawnKey_ ^= movedKeys[to];
+            removePiece(to);
+            putPiece(to, {move.promotion(), us});
+        }
+
+        if (move.isCastling()) {
             bool kingSide = to > from;
-            int rookFrom, rookTo;
-            
-            if (kingSide) {
-                rookFrom = (from / 8) * 8 + 7;
-                rookTo = to - 1; 
-            } else {
-                rookFrom = (from / 8) * 8;  
-                rookTo = to + 1; 
-            }
-            
-            uint64_t rookFromMask = 1ULL << rookFrom;
-            uint64_t rookToMask = 1ULL << rookTo;
-            
-            for (int c = 0; c < 2; ++c) {
-                for (int p = 0; p < 6; ++p) {
-                    pieces_[c][p] &= ~rookFromMask;
-                    pieces_[c][p] &= ~rookToMask;
-                }
-            }
-            pieces_[static_cast<int>(us)][static_cast<int>(PieceType::ROOK)] |= rookToMask;
-        }
-
-        if (moved.type == PieceType::KING) {
-            castlingRights_[static_cast<int>(us)][0] = false;
-            castlingRights_[static_cast<int>(us)][1] = false;
-        }
-        if (moved.type == PieceType::ROOK) {
-            if (from == 0) castlingRights_[0][1] = false;
-            else if (from == 7) castlingRights_[0][0] = false; 
-            else if (from == 56) castlingRights_[1][1] = false;
-            else if (from == 63) castlingRights_[1][0] = false;
+            int rookFrom = kingSide ? (from / 8) * 8 + 7 : (from / 8) * 8;
+            int rookTo = kingSide ? to - 1 : to + 1;
+            const auto& rookKeys = Zobrist::PIECES[static_cast<int>(us)][static_cast<int>(PieceType::ROOK)];
+            key ^= rookKeys[rookFrom] ^ rookKeys[rookTo];
+            movePiece(rookFrom, rookTo);
         }
+        
+        castling_ &= ~(CASTLING_SPOILERS[from] | CASTLING_SPOILERS[to]);
 
-        if (moved.type == PieceType::PAWN && std::abs(to - from) == 16) {
+        if (moved == PieceType::PAWN && std::abs(to - from) == 16) {
             enPassant_ = static_cast<Square>((us == Color::WHITE) ? (from + 8) : (from - 8));
+            key ^= Zobrist::EN_PASSANT[from % 8];
         } else {
             enPassant_ = Square::NONE;
         }
         
-        updateBitboards();
         sideToMove_ = them;
-        moveStack_.push_back(move);
         
-        if (moved.type == PieceType::PAWN || captured.type != PieceType::NONE) {
+        if (moved == PieceType::PAWN || move.isCapture()) {
             halfmoveClock_ = 0;
         } else {
             ++halfmoveClock_;
         }
+        ++pliesFromNull_;
         
         if (us == Color::BLACK) ++fullmoveNumber_;
 		
-		positionHistory_.push_back(computeHash());
+		hash_ = key ^ Zobrist::CASTLING[castling_];
+        
+        if (Nnue::active && moved == PieceType::KING) refreshAccumulator(us);
     }
     
     void unmakeMove() {
-        if (!stateStack_.empty() && !moveStack_.empty()) {
-            BoardState state = stateStack_.back();
-            stateStack_.pop_back();
-            
-            memcpy(pieces_, state.pieces, sizeof(pieces_));
-            occupied_ = state.occupied;
-            empty_ = state.empty;
-            sideToMove_ = state.sideToMove;
-            enPassant_ = state.enPassant;
-            memcpy(castlingRights_, state.castlingRights, sizeof(castlingRights_));
-            halfmoveClock_ = state.halfmoveClock;
-            fullmoveNumber_ = state.fullmoveNumber;
-            
-			if (!positionHistory_.empty()) {
-				positionHistory_.pop_back();
-			}
-			
-			moveStack_.pop_back();
+        if (ply_ == 0) return;
+        
+        const UndoInfo& undo = undo_[--ply_];
+        const Move& move = undo.move;
+        
+        sideToMove_ = (sideToMove_ == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        if (sideToMove_ == Color::BLACK) --fullmoveNumber_;
+        hash_ = undo.hash;
+        pawnKey_ = undo.pawnKey;
+        castling_ = undo.castling;
+        enPassant_ = undo.enPassant;
+        halfmoveClock_ = undo.halfmoveClock;
+        pliesFromNull_ = undo.pliesFromNull;
+        
+        int from = static_cast<int>(move.from());
+        int to = static_cast<int>(move.to());
+        
+        if (move.isPromotion()) {
+            removePiece(to);
+            putPiece(to, {PieceType::PAWN, sideToMove_});
+        }
+        movePiece(to, from);
+        
+        if (move.isCastling()) {
+            bool kingSide = to > from;
+            int rookFrom = kingSide ? (from / 8) * 8 + 7 : (from / 8) * 8;
+            int rookTo = kingSide ? to - 1 : to + 1;
+            movePiece(rookTo, rookFrom);
+        }
+        
+        if (move.isCapture()) {
+            Color them = (sideToMove_ == Color::WHITE) ? Color::BLACK : Color::WHITE;
+            int capturedSq = move.isEnPassant() ? ((sideToMove_ == Color::WHITE) ? to - 8 : to + 8) : to;
+            putPiece(capturedSq, {move.captured(), them});
         }
+        
+        if (Nnue::active && move.moved() == PieceType::KING) refreshAccumulator(sideToMove_);
     }
     
     void makeNullMove() {
-        BoardState state;
-        memcpy(state.pieces, pieces_, sizeof(pieces_));
-        state.occupied = occupied_;
-        state.empty = empty_;
-        state.sideToMove = sideToMove_;
-        state.enPassant = enPassant_;
-        memcpy(state.castlingRights, castlingRights_, sizeof(castlingRights_));
-        state.halfmoveClock = halfmoveClock_;
-        state.fullmoveNumber = fullmoveNumber_;
-        stateStack_.push_back(state);
-
+        if (ply_ == MAX_GAME_PLY) compactHistory();
+        
+        UndoInfo& undo = undo_[ply_++];
+        undo.hash = hash_;
+        undo.pawnKey = pawnKey_;
+        undo.move = Move();
+        undo.castling = castling_;
+        undo.enPassant = enPassant_;
+        undo.halfmoveClock = static_cast<int16_t>(halfmoveClock_);
+        undo.pliesFromNull = static_cast<int16_t>(pliesFromNull_);
+
+        if (enPassant_ != Square::NONE) hash_ ^= Zobrist::EN_PASSANT[static_cast<int>(enPassant_) % 8];
+        hash_ ^= Zobrist::SIDE;
         enPassant_ = Square::NONE;
         sideToMove_ = (sideToMove_ == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        halfmoveClock_++;
-		positionHistory_.push_back(computeHash());
+        pliesFromNull_ = 0;
     }
     
     void unmakeNullMove() {
-        if (!stateStack_.empty()) {
-            BoardState state = stateStack_.back();
-            stateStack_.pop_back();
-            
-            memcpy(pieces_, state.pieces, sizeof(pieces_));
-            occupied_ = state.occupied;
-            empty_ = state.empty;
-            sideToMove_ = state.sideToMove;
-            enPassant_ = state.enPassant;
-            memcpy(castlingRights_, state.castlingRights, sizeof(castlingRights_));
-            halfmoveClock_ = state.halfmoveClock;
-            fullmoveNumber_ = state.fullmoveNumber;
-			if (!positionHistory_.empty()) positionHistory_.pop_back();
+        if (ply_ == 0) return;
+        
+        const UndoInfo& undo = undo_[--ply_];
+        hash_ = undo.hash;
+        enPassant_ = undo.enPassant;
+        halfmoveClock_ = undo.halfmoveClock;
+        pliesFromNull_ = undo.pliesFromNull;
+        sideToMove_ = (sideToMove_ == Color::WHITE) ? Color::BLACK : Color::WHITE;
+    }
+    
+    AttackInfo computeAttackInfo() const {
+        AttackInfo info;
+        Color us = sideToMove_;
+        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        uint64_t ourKing = pieces_[static_cast<int>(us)][5];
+        uint64_t theirKing = pieces_[static_cast<int>(them)][5];
+        
+        if (ourKing) {
+            int kingSq = lsbIndex(ourKing);
+            info.checkers = attackersOf(kingSq, them, occupied_);
+            info.pinned = computePins(us, kingSq);
+        }
+        if (theirKing) {
+            Square kingSq = static_cast<Square>(lsbIndex(theirKing));
+            auto& cs = info.checkSquares;
+            cs[0] = Attacks::pawnAttacks(them, kingSq);
+            cs[1] = Attacks::knightAttacks(kingSq);
+            cs[2] = Attacks::bishopAttacks(kingSq, occupied_);
+            cs[3] = Attacks::rookAttacks(kingSq, occupied_);
+            cs[4] = cs[2] | cs[3];
+            cs[5] = 0;
         }
+        return info;
     }
     
-    std::vector<Move> generateMoves() const {
-        std::vector<Move> moves;
-        moves.reserve(128);
-        
+    MoveList generateMoves() const {
+        return generateMoves(computeAttackInfo());
+    }
+    
+    // Same rules as generate<LEGAL>, but stops at the first legal move.
+    // Castling needs no test: if it is legal, so is the king's first step.
+    bool hasAnyLegalMove(const AttackInfo& info) const {
         Color us = sideToMove_;
         Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        const auto& ours = pieces_[static_cast<int>(us)];
         uint64_t occ = occupied_;
-        uint64_t emptySq = empty_;
-        
-        uint64_t ourPieces = 0, enemy = 0;
-        for (int p = 0; p < 6; ++p) {
-            ourPieces |= pieces_[static_cast<int>(us)][p];
-            enemy |= pieces_[static_cast<int>(them)][p];
-        }
-
-        uint64_t kings = pieces_[static_cast<int>(us)][5];
-        if (!kings) return moves;
-        int kingSq = lsbIndex(kings);
-
-        PinInfo pinInfo = computePins(us);
-
-        bool inCheck = isSquareAttackedBy(static_cast<Square>(kingSq), them, occ);
-        uint64_t checkers = 0;
-        
-        if (inCheck) {
-            uint64_t enemyPawns = pieces_[static_cast<int>(them)][0];
-            if (them == Color::WHITE) {
-                if (kingSq >= 8) {
-                    if ((kingSq % 8) > 0 && (enemyPawns & (1ULL << (kingSq - 9)))) checkers |= (1ULL << (kingSq - 9));
-                    if ((kingSq % 8) < 7 && (enemyPawns & (1ULL << (kingSq - 7)))) checkers |= (1ULL << (kingSq - 7));
-                }
-            } else {
-                if (kingSq < 56) {
-                    if ((kingSq % 8) > 0 && (enemyPawns & (1ULL << (kingSq + 7)))) checkers |= (1ULL << (kingSq + 7));
-                    if ((kingSq % 8) < 7 && (enemyPawns & (1ULL << (kingSq + 9)))) checkers |= (1ULL << (kingSq + 9));
-                }
-            }
-            
-            uint64_t knights = pieces_[static_cast<int>(them)][1];
-            checkers |= Attacks::knightAttacks(static_cast<Square>(kingSq)) & knights;
-            
-            uint64_t bishops = pieces_[static_cast<int>(them)][2] | pieces_[static_cast<int>(them)][4];
-            checkers |= Attacks::bishopAttacks(static_cast<Square>(kingSq), occ) & bishops;
+        uint64_t ourPieces = colors_[static_cast<int>(us)];
+        uint64_t enemy = colors_[static_cast<int>(them)];
+        
+        if (!ours[5]) return false;
+        int kingSq = lsbIndex(ours[5]);
+        uint64_t pinned = info.pinned;
+        uint64_t checkers = info.checkers;
+        
+        if (::popcount(checkers) <= 1) {
+            uint64_t blockCaptureSquares = checkers ? checkers | Attacks::BETWEEN[kingSq][lsbIndex(checkers)] : ~0ULL;
+            int up = (us == Color::WHITE) ? 8 : -8;
+            uint64_t pushRank = (us == Color::WHITE) ? 0x0000000000FF0000ULL : 0x0000FF0000000000ULL;
             
-            uint64_t rooks = pieces_[static_cast<int>(them)][3] | pieces_[static_cast<int>(them)][4];
-            checkers |= Attacks::rookAttacks(static_cast<Square>(kingSq), occ) & rooks;
-        }
-        
-        bool doubleCheck = inCheck && ::popcount(checkers) > 1;
-        uint64_t blockCaptureSquares = ~0ULL;
-        if (inCheck && !doubleCheck && checkers) {
-            int checkerSq = lsbIndex(checkers);
-            blockCaptureSquares = checkers;
-
-            auto checkerPiece = pieceAt(static_cast<Square>(checkerSq));
-            if (checkerPiece.type == PieceType::BISHOP || 
-                checkerPiece.type == PieceType::ROOK || 
-                checkerPiece.type == PieceType::QUEEN) {
-                blockCaptureSquares |= squaresBetween(kingSq, checkerSq);
-            }
-        }
-
-        if (!doubleCheck) {
-            uint64_t pawns = pieces_[static_cast<int>(us)][0];
+            uint64_t pawns = ours[0];
             while (pawns) {
                 int from = lsbIndex(pawns);
                 pawns &= pawns - 1;
                 
-                bool isPinned = (pinInfo.pinned & (1ULL << from)) != 0;
-                uint64_t legalSquares = isPinned ? pinInfo.pinRays[from] : ~0ULL;
+                uint64_t legalSquares = (pinned & (1ULL << from)) ? Attacks::LINE[kingSq][from] : ~0ULL;
                 legalSquares &= blockCaptureSquares;
                 
-                if (us == Color::WHITE) {
-                    int to = from + 8;
-                    if (to < 64 && (emptySq & (1ULL << to)) && (legalSquares & (1ULL << to))) {
-                        if (to >= 56) {
-                            for (int promo = 1; promo <= 4; ++promo) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                 static_cast<PieceType>(promo));
-                            }
-                        } else {
-                            moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-
-                            if (from >= 8 && from < 16) {
-                                int to2 = from + 16;
-                                if ((emptySq & (1ULL << to2)) && (legalSquares & (1ULL << to2))) {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to2));
-                                }
-                            }
-                        }
-                    }
-
-                    if (from % 8 > 0) {
-                        int to = from + 7;
-                        if (to < 64 && (legalSquares & (1ULL << to))) {
-                            if (enemy & (1ULL << to)) {
-                                if (to >= 56) {
-                                    for (int promo = 1; promo <= 4; ++promo) {
-                                        moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                         static_cast<PieceType>(promo));
-                                    }
-                                } else {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                                }
-                            } else if (static_cast<Square>(to) == enPassant_ && 
-                                      isEnPassantLegal(static_cast<Square>(from), static_cast<Square>(to), us)) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                            }
-                        }
-                    }
-                    if (from % 8 < 7) {
-                        int to = from + 9;
-                        if (to < 64 && (legalSquares & (1ULL << to))) {
-                            if (enemy & (1ULL << to)) {
-                                if (to >= 56) {
-                                    for (int promo = 1; promo <= 4; ++promo) {
-                                        moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                         static_cast<PieceType>(promo));
-                                    }
-                                } else {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                                }
-                            } else if (static_cast<Square>(to) == enPassant_ && 
-                                      isEnPassantLegal(static_cast<Square>(from), static_cast<Square>(to), us)) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                            }
-                        }
-                    }
-                } else {
-                    int to = from - 8;
-                    if (to >= 0 && (emptySq & (1ULL << to)) && (legalSquares & (1ULL << to))) {
-                        if (to <= 7) {
-                            for (int promo = 1; promo <= 4; ++promo) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                 static_cast<PieceType>(promo));
-                            }
-                        } else {
-                            moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                            
-                            if (from >= 48 && from < 56) {
-                                int to2 = from - 16;
-                                if ((emptySq & (1ULL << to2)) && (legalSquares & (1ULL << to2))) {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to2));
-                                }
-                            }
-                        }
-                    }
-                    
-                    if (from % 8 > 0) {
-                        int to = from - 9;
-                        if (to >= 0 && (legalSquares & (1ULL << to))) {
-                            if (enemy & (1ULL << to)) {
-                                if (to <= 7) {
-                                    for (int promo = 1; promo <= 4; ++promo) {
-                                        moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                         static_cast<PieceType>(promo));
-                                    }
-                                } else {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                                }
-                            } else if (static_cast<Square>(to) == enPassant_ && 
-                                      isEnPassantLegal(static_cast<Square>(from), static_cast<Square>(to), us)) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                            }
-                        }
-                    }
-                    if (from % 8 < 7) {
-                        int to = from - 7;
-                        if (to >= 0 && (legalSquares & (1ULL << to))) {
-                            if (enemy & (1ULL << to)) {
-                                if (to <= 7) {
-                                    for (int promo = 1; promo <= 4; ++promo) {
-                                        moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to), 
-                                                         static_cast<PieceType>(promo));
-                                    }
-                                } else {
-                                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                                }
-                            } else if (static_cast<Square>(to) == enPassant_ && 
-                                      isEnPassantLegal(static_cast<Square>(from), static_cast<Square>(to), us)) {
-                                moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                            }
-                        }
-                    }
+                int to = from + up;
+                if (~occ & (1ULL << to)) {
+                    if (legalSquares & (1ULL << to)) return true;
+                    if ((pushRank & (1ULL << to)) && (~occ & legalSquares & (1ULL << (to + up)))) return true;
+                }
+                
+                uint64_t attacks = Attacks::pawnAttacks(us, static_cast<Square>(from));
+                if (attacks & enemy & legalSquares) return true;
+                
+                if (enPassant_ != Square::NONE && (attacks & (1ULL << static_cast<int>(enPassant_)))) {
+                    int epTo = static_cast<int>(enPassant_);
+                    uint64_t capturedPawn = 1ULL << (epTo - up);
+                    if ((blockCaptureSquares & ((1ULL << epTo) | capturedPawn)) &&
+                        isEnPassantLegal(static_cast<Square>(from), enPassant_, us)) return true;
                 }
             }
             
-            uint64_t knights = pieces_[static_cast<int>(us)][1];
+            uint64_t pieceTarget = ~ourPieces & blockCaptureSquares;
+            
+            uint64_t knights = ours[1] & ~pinned;
             while (knights) {
                 int from = lsbIndex(knights);
                 knights &= knights - 1;
-                
-                if (pinInfo.pinned & (1ULL << from)) continue;
-                
-                uint64_t attacks = Attacks::knightAttacks(static_cast<Square>(from));
-                attacks &= (emptySq | enemy) & blockCaptureSquares;
-                
-                while (attacks) {
-                    int to = lsbIndex(attacks);
-                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                    attacks &= attacks - 1;
-                }
-            }
-
-            uint64_t bishops = pieces_[static_cast<int>(us)][2];
-            while (bishops) {
-                int from = lsbIndex(bishops);
-                bishops &= bishops - 1;
-                
-                bool isPinned = (pinInfo.pinned & (1ULL << from)) != 0;
-                uint64_t legalSquares = isPinned ? pinInfo.pinRays[from] : ~0ULL;
-                legalSquares &= blockCaptureSquares;
-                
-                uint64_t attacks = Attacks::bishopAttacks(static_cast<Square>(from), occ);
-                attacks &= (emptySq | enemy) & legalSquares;
-                
-                while (attacks) {
-                    int to = lsbIndex(attacks);
-                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                    attacks &= attacks - 1;
-                }
-            }
-
-            uint64_t rooks = pieces_[static_cast<int>(us)][3];
-            while (rooks) {
-                int from = lsbIndex(rooks);
-                rooks &= rooks - 1;
-                
-                bool isPinned = (pinInfo.pinned & (1ULL << from)) != 0;
-                uint64_t legalSquares = isPinned ? pinInfo.pinRays[from] : ~0ULL;
-                legalSquares &= blockCaptureSquares;
-                
-                uint64_t attacks = Attacks::rookAttacks(static_cast<Square>(from), occ);
-                attacks &= (emptySq | enemy) & legalSquares;
-                
-                while (attacks) {
-                    int to = lsbIndex(attacks);
-                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                    attacks &= attacks - 1;
-                }
+                if (Attacks::knightAttacks(static_cast<Square>(from)) & pieceTarget) return true;
             }
-
-            uint64_t queens = pieces_[static_cast<int>(us)][4];
-            while (queens) {
-                int from = lsbIndex(queens);
-                queens &= queens - 1;
-                
-                bool isPinned = (pinInfo.pinned & (1ULL << from)) != 0;
-                uint64_t legalSquares = isPinned ? pinInfo.pinRays[from] : ~0ULL;
-                legalSquares &= blockCaptureSquares;
-                
-                uint64_t attacks = Attacks::queenAttacks(static_cast<Square>(from), occ);
-                attacks &= (emptySq | enemy) & legalSquares;
+            
+            uint64_t sliders = ours[2] | ours[3] | ours[4];
+            while (sliders) {
+                int from = lsbIndex(sliders);
+                sliders &= sliders - 1;
                 
-                while (attacks) {
-                    int to = lsbIndex(attacks);
-                    moves.emplace_back(static_cast<Square>(from), static_cast<Square>(to));
-                    attacks &= attacks - 1;
-                }
+                uint64_t attacks = 0;
+                if ((ours[2] | ours[4]) & (1ULL << from)) attacks |= Attacks::bishopAttacks(static_cast<Square>(from), occ);
+                if ((ours[3] | ours[4]) & (1ULL << from)) attacks |= Attacks::rookAttacks(static_cast<Square>(from), occ);
+                attacks &= pieceTarget;
+                if (pinned & (1ULL << from)) attacks &= Attacks::LINE[kingSq][from];
+                if (attacks) return true;
             }
         }
         
-        uint64_t kingAttacks = Attacks::kingAttacks(static_cast<Square>(kingSq));
-        kingAttacks &= (emptySq | enemy) & ~ourPieces;
-        
-        while (kingAttacks) {
-            int to = lsbIndex(kingAttacks);
-            kingAttacks &= kingAttacks - 1;
-
+        uint64_t kingTargets = Attacks::kingAttacks(static_cast<Square>(kingSq)) & ~ourPieces;
+        while (kingTargets) {
+            int to = lsbIndex(kingTargets);
+            kingTargets &= kingTargets - 1;
+            
             uint64_t newOccupied = (occ & ~(1ULL << kingSq)) | (1ULL << to);
-            if (!isSquareAttackedBy(static_cast<Square>(to), them, newOccupied)) {
-                moves.emplace_back(static_cast<Square>(kingSq), static_cast<Square>(to));
-            }
+            if (!isSquareAttackedBy(static_cast<Square>(to), them, newOccupied)) return true;
+        }
+        return false;
+    }
+    
+    MoveList generateMoves(const AttackInfo& info) const {
+        MoveList moves;
+        generate<GenType::LEGAL>(moves, info);
+        return moves;
+    }
+	
+    MoveList generateCaptures(const AttackInfo& info) const {
+        MoveList moves;
+        generate<GenType::CAPTURES>(moves, info);
+        return moves;
+    }
+    
+    MoveList generateQuiets(const AttackInfo& info) const {
+        MoveList moves;
+        generate<GenType::QUIETS>(moves, info);
+        return moves;
+    }
+    
+    MoveList generateEvasions(const AttackInfo& info) const {
+        MoveList moves;
+        generate<GenType::EVASIONS>(moves, info);
+        return moves;
+    }
+    
+    // Validates a move that did not come from the generator (TT move, killer)
+    // without generating the full move list in the common cases.
+    // The piece and flag bits must match this position too, so a killer
+    // recorded elsewhere is only accepted if it is the very same move here.
+    bool isLegal(const Move& move) const {
+        return isLegal(move, computeAttackInfo());
+    }
+    
+    bool isLegal(const Move& move, const AttackInfo& info) const {
+        if (move.from() == move.to()) return false;
+        
+        Color us = sideToMove_;
+        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        int from = static_cast<int>(move.from());
+        int to = static_cast<int>(move.to());
+        uint64_t toMask = 1ULL << to;
+        
+        Piece moved = board_[from];
+        if (moved.color != us || moved.type != move.moved()) return false;
+        Piece target = board_[to];
+        if (target.color == us || target.type == PieceType::KING) return false;
+        if (!move.isEnPassant() && move.captured() != target.type) return false;
+        
+        uint64_t kings = pieces_[static_cast<int>(us)][5];
+        if (!kings) return false;
+        int kingSq = lsbIndex(kings);
+        
+        if (move.isCastling() || info.checkers) {
+            return generateMoves(info).contains(move);
         }
         
-        if (!inCheck) {
-            int backRank = (us == Color::WHITE) ? 0 : 56;
-
-            if (castlingRights_[static_cast<int>(us)][0] && kingSq == backRank + 4) {
-                int f1 = backRank + 5;
-                int g1 = backRank + 6;
-                int h1 = backRank + 7;
-                
-                if (!(occ & ((1ULL << f1) | (1ULL << g1))) &&
-                    (pieces_[static_cast<int>(us)][3] & (1ULL << h1)) &&
-                    !isSquareAttackedBy(static_cast<Square>(f1), them, occ) &&
-                    !isSquareAttackedBy(static_cast<Square>(g1), them, occ)) {
-                    moves.emplace_back(static_cast<Square>(kingSq), static_cast<Square>(g1));
-                }
-            }
-
-            if (castlingRights_[static_cast<int>(us)][1] && kingSq == backRank + 4) {
-                int a1 = backRank;
-                int b1 = backRank + 1;
-                int c1 = backRank + 2;
-                int d1 = backRank + 3;
+        if (moved.type != PieceType::PAWN && (move.isPromotion() || move.isEnPassant())) return false;
+        
+        switch (moved.type) {
+            case PieceType::PAWN: {
+                int up = (us == Color::WHITE) ? 8 : -8;
+                bool lastRank = (us == Color::WHITE) ? (to >= 56) : (to <= 7);
+                if (lastRank != move.isPromotion()) return false;
+                if (move.promotion() == PieceType::KING) return false;
                 
-                if (!(occ & ((1ULL << b1) | (1ULL << c1) | (1ULL << d1))) &&
-                    (pieces_[static_cast<int>(us)][3] & (1ULL << a1)) &&
-                    !isSquareAttackedBy(static_cast<Square>(c1), them, occ) &&
-                    !isSquareAttackedBy(static_cast<Square>(d1), them, occ)) {
-                    moves.emplace_back(static_cast<Square>(kingSq), static_cast<Square>(c1));
+                if (to == from + up) {
+                    if (target.type != PieceType::NONE) return false;
+                } else if (to == from + 2 * up) {
+                    int startRank = (us == Color::WHITE) ? 1 : 6;
+                    if (from / 8 != startRank || (occupied_ & ((1ULL << (from + up)) | toMask))) return false;
+                } else if (Attacks::pawnAttacks(us, move.from()) & toMask) {
+                    if (move.isEnPassant() != (move.to() == enPassant_)) return false;
+                    if (move.isEnPassant()) return isEnPassantLegal(move.from(), move.to(), us);
+                    if (target.type == PieceType::NONE) return false;
+                } else {
+                    return false;
                 }
+                if (move.isEnPassant()) return false;
+                break;
             }
+            case PieceType::KNIGHT:
+                if (!(Attacks::knightAttacks(move.from()) & toMask)) return false;
+                break;
+            case PieceType::BISHOP:
+                if (!(Attacks::bishopAttacks(move.from(), occupied_) & toMask)) return false;
+                break;
+            case PieceType::ROOK:
+                if (!(Attacks::rookAttacks(move.from(), occupied_) & toMask)) return false;
+                break;
+            case PieceType::QUEEN:
+                if (!(Attacks::queenAttacks(move.from(), occupied_) & toMask)) return false;
+                break;
+            case PieceType::KING:
+                return (Attacks::kingAttacks(move.from()) & toMask) &&
+                       !isSquareAttackedBy(move.to(), them, occupied_ & ~(1ULL << from));
+            default:
+                return false;
         }
         
-        return moves;
+        return !(info.pinned & (1ULL << from)) || (Attacks::LINE[kingSq][from] & toMask);
     }
-	
-    std::vector<Move> generateCaptures() const {
-        std::vector<Move> captures;
-        auto allMoves = generateMoves();
-        for (const auto& move : allMoves) {
-            if (isCapture(move)) captures.push_back(move);
+    
+    int gamePly() const { return ply_; }
+    
+    // Rebuilds a full move from its 16-bit form (TT, book, UCI input) by
+    // reading the pieces off the board. The result still needs isLegal().
+    Move decodeMove(uint16_t compact) const {
+        int from = compact & 0x3F;
+        int to = (compact >> 6) & 0x3F;
+        int promo = (compact >> 12) & 0x7;
+        PieceType moved = board_[from].type;
+        if (from == to || moved == PieceType::NONE) return Move();
+        
+        PieceType promotion = promo ? static_cast<PieceType>(promo) : PieceType::NONE;
+        if (moved == PieceType::PAWN && static_cast<Square>(to) == enPassant_) {
+            return Move(from, to, moved, PieceType::PAWN, promotion, Move::EN_PASSANT);
         }
-        return captures;
+        uint32_t flags = (moved == PieceType::KING && std::abs(to - from) == 2) ? Move::CASTLING : 0;
+        return Move(from, to, moved, board_[to].type, promotion, flags);
     }
     
-    const std::vector<Move>& moveStack() const { return moveStack_; }
-    
     std::vector<std::pair<Square, Piece>> pieceList() const {
         std::vector<std::pair<Square, Piece>> list;
         for (int sq = 0; sq < 64; ++sq) {
@@ -1120,6 +1787,10 @@ public:
     
     int popcount() const { return __builtin_popcountll(occupied_); }
     
+    bool isAttackedBy(Square sq, Color attacker) const {
+        return isSquareAttacked(sq, attacker);
+    }
+    
     inline bool isInCheck(Color color) const {
         uint64_t kings = pieces_[static_cast<int>(color)][5];
         if (kings == 0) return false;
@@ -1157,7 +1828,7 @@ private:
         return key;
     }
     
-    Move decodeMove(uint16_t move16, const Board&) const {
+    Move decodeMove(uint16_t move16, const Board& board) const {
         int from = ((move16 >> 6) & 0x3F) ^ 0x38;
         int to = (move16 & 0x3F) ^ 0x38;
         int promo = (move16 >> 12) & 0x7;
@@ -1168,7 +1839,7 @@ private:
         else if (promo == 3) ptype = PieceType::ROOK;
         else if (promo == 4) ptype = PieceType::QUEEN;
         
-        return Move(static_cast<Square>(from), static_cast<Square>(to), ptype);
+        return board.decodeMove(Move::pack(from, to, ptype));
     }
     
 public:
@@ -1193,7 +1864,7 @@ public:
     bool isLoaded() const { return !entries.empty(); }
     
     std::optional<Move> getMove(const Board& board) {
-        if (board.moveStack().size() > 20 || entries.empty()) return std::nullopt;
+        if (board.gamePly() > 20 || entries.empty()) return std::nullopt;
         
         uint64_t key = computeKey(board);
         std::vector<BookEntry> matches;
@@ -1227,144 +1898,156 @@ constexpr Score ROOK_OPEN_FILE_BONUS = 0;
 constexpr Score DOUBLED_PAWN_PENALTY = 15;
 constexpr Score ISOLATED_PAWN_PENALTY = 20;
 
+// Pawn Hash
+// Everything that depends on the pawns alone, keyed by Board::pawnKey().
+// Scores are white-relative.
+struct PawnEntry {
+    uint64_t key = 0;
+    Score mg = 0;
+    Score eg = 0;
+    uint64_t attacks[2] = {0, 0};
+    uint64_t attackSpan[2] = {0, 0};  // every square the pawns could attack as they advance
+    uint64_t passed[2] = {0, 0};
+};
+
+constexpr int PAWN_TABLE_SIZE = 1 << 14;
+
+// Material Hash
+// Terms that depend only on the material signature, keyed by
+// Board::materialKey().
+struct MaterialEntry {
+    uint64_t key = ~0ULL;  // 0 is the bare kings signature
+    int phase = 0;
+    Score mg = 0;
+    Score eg = 0;
+    std::array<uint8_t, 2> scale = {64, 64};  // endgame scale (out of 64) when that color is ahead
+    bool draw = false;
+};
+
+constexpr int MATERIAL_TABLE_SIZE = 1 << 13;
+
 struct Evaluator {
-    std::array<int, 6> pieceValues = {100, 320, 330, 500, 900, 20000};
-	
-    const std::array<int, 64> pawnTableMg = {
-         0,  0,  0,  0,  0,  0,  0,  0,
-         5, 10, 10,-20,-20, 10, 10,  5,
-         5, -5,-10,  0,  0,-10, -5,  5,
-         0,  0,  0, 20, 20,  0,  0,  0,
-         5,  5, 10, 25, 25, 10,  5,  5,
-        10, 10, 20, 30, 30, 20, 10, 10,
-        50, 50, 50, 50, 50, 50, 50, 50,
-         0,  0,  0,  0,  0,  0,  0,  0
-    };
-    
-    const std::array<int, 64> pawnTableEg = {
-         0,  0,  0,  0,  0,  0,  0,  0,
-        10, 10, 10, 10, 10, 10, 10, 10,
-        10, 10, 10, 10, 10, 10, 10, 10,
-        20, 20, 20, 20, 20, 20, 20, 20,
-        30, 30, 30, 30, 30, 30, 30, 30,
-        40, 40, 40, 40, 40, 40, 40, 40,
-        50, 50, 50, 50, 50, 50, 50, 50,
-         0,  0,  0,  0,  0,  0,  0,  0
-    };
-    
-    const std::array<int, 64> knightTable = {
-        -50,-40,-30,-30,-30,-30,-40,-50,
-        -40,-20,  0,  5,  5,  0,-20,-40,
-        -30,  5, 10, 15, 15, 10,  5,-30,
-        -30,  0, 15, 20, 20, 15,  0,-30,
-        -30,  5, 15, 20, 20, 15,  5,-30,
-        -30,  0, 10, 15, 15, 10,  0,-30,
-        -40,-20,  0,  0,  0,  0,-20,-40,
-        -50,-40,-30,-30,-30,-30,-40,-50
-    };
-    
-    const std::array<int, 64> bishopTable = {
-        -20,-10,-10,-10,-10,-10,-10,-20,
-        -10,  5,  0,  0,  0,  0,  5,-10,
-        -10, 10, 10, 10, 10, 10, 10,-10,
-        -10,  0, 10, 10, 10, 10,  0,-10,
-        -10,  5,  5, 10, 10,  5,  5,-10,
-        -10,  0,  5, 10, 10,  5,  0,-10,
-        -10,  0,  0,  0,  0,  0,  0,-10,
-        -20,-10,-10,-10,-10,-10,-10,-20
-    };
-    
-    const std::array<int, 64> rookTable = {
-         0,  0,  0,  5,  5,  0,  0,  0,
-        -5,  0,  0,  0,  0,  0,  0, -5,
-        -5,  0,  0,  0,  0,  0,  0, -5,
-        -5,  0,  0,  0,  0,  0,  0, -5,
-        -5,  0,  0,  0,  0,  0,  0, -5,
-        -5,  0,  0,  0,  0,  0,  0, -5,
-         5, 10, 10, 10, 10, 10, 10,  5,
-         0,  0,  0,  0,  0,  0,  0,  0
-    };
+    static constexpr Score LAZY_MARGIN = 400;  // tuned by hand, see evaluate()
     
-    const std::array<int, 64> queenTable = {
-        -20,-10,-10, -5, -5,-10,-10,-20,
-        -10,  0,  5,  0,  0,  0,  0,-10,
-        -10,  5,  5,  5,  5,  5,  0,-10,
-          0,  0,  5,  5,  5,  5,  0, -5,
-         -5,  0,  5,  5,  5,  5,  0, -5,
-        -10,  0,  5,  5,  5,  5,  0,-10,
-        -10,  0,  0,  0,  0,  0,  0,-10,
-        -20,-10,-10, -5, -5,-10,-10,-20
-    };
+    std::array<int, 6> pieceValues = Pst::PIECE_VALUES;
+    std::vector<PawnEntry> pawnTable = std::vector<PawnEntry>(PAWN_TABLE_SIZE);
+    std::vector<MaterialEntry> materialTable = std::vector<MaterialEntry>(MATERIAL_TABLE_SIZE);
     
-    const std::array<int, 64> kingTableMg = {
-        20, 30, 10,  0,  0, 10, 30, 20,
-        20, 20,  0,  0,  0,  0, 20, 20,
-        -10,-20,-20,-20,-20,-20,-20,-10,
-        -20,-30,-30,-40,-40,-30,-30,-20,
-        -30,-40,-40,-50,-50,-40,-40,-30,
-        -30,-40,-40,-50,-50,-40,-40,-30,
-        -30,-40,-40,-50,-50,-40,-40,-30,
-        -30,-40,-40,-50,-50,-40,-40,-30
-    };
+    inline int tapered(int mg, int eg, int phase) const {
+        return (mg * phase + eg * (24 - phase)) / 24;
+    }
     
-    const std::array<int, 64> kingTableEg = {
-        -50,-30,-30,-30,-30,-30,-30,-50,
-        -30,-30,  0,  0,  0,  0,-30,-30,
-        -30,-10, 20, 30, 30, 20,-10,-30,
-        -30,-10, 30, 40, 40, 30,-10,-30,
-        -30,-10, 30, 40, 40, 30,-10,-30,
-        -30,-10, 20, 30, 30, 20,-10,-30,
-        -30,-20,-10,  0,  0,-10,-20,-30,
-        -50,-40,-30,-20,-20,-30,-40,-50
-    };
+    Score evaluatePawnStructure(uint64_t pawns, Color color) const {
+        Score score = 0;
+        
+        for (int file = 0; file < 8; ++file) {
+            int count = popcount(pawns & (0x0101010101010101ULL << file));
+            if (count > 1) score -= DOUBLED_PAWN_PENALTY * (count - 1);
+            if (count > 0 && (pawns & Attacks::ADJACENT_FILES[file]) == 0) score -= ISOLATED_PAWN_PENALTY;
+        }
+        
+        Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        uint64_t connected = pawns & (Attacks::pawnAttacks(enemy, pawns) |
+                                      ((pawns << 1) & ~0x0101010101010101ULL) |
+                                      ((pawns >> 1) & ~0x8080808080808080ULL));
+        score += popcount(connected) * 8;
+        
+        return score;
+    }
     
-    int gamePhase(const Board& board) const {
-        int phase = 0;
-        phase += popcount(board.getBitboard(PieceType::KNIGHT, Color::WHITE)) * 1;
-        phase += popcount(board.getBitboard(PieceType::KNIGHT, Color::BLACK)) * 1;
-        phase += popcount(board.getBitboard(PieceType::BISHOP, Color::WHITE)) * 1;
-        phase += popcount(board.getBitboard(PieceType::BISHOP, Color::BLACK)) * 1;
-        phase += popcount(board.getBitboard(PieceType::ROOK, Color::WHITE)) * 2;
-        phase += popcount(board.getBitboard(PieceType::ROOK, Color::BLACK)) * 2;
-        phase += popcount(board.getBitboard(PieceType::QUEEN, Color::WHITE)) * 4;
-        phase += popcount(board.getBitboard(PieceType::QUEEN, Color::BLACK)) * 4;
-        return std::min(24, phase);
+    Score evaluatePassedPawns(uint64_t passed, uint64_t pawns, Color color) const {
+        Score score = 0;
+        Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
+        
+        while (passed) {
+            int sq = lsbIndex(passed);
+            passed &= passed - 1;
+            
+            int rank = sq / 8;
+            score += (color == Color::WHITE) ? (rank - 1) * 20 : (6 - rank) * 20;
+            if (Attacks::pawnAttacks(enemy, static_cast<Square>(sq)) & pawns) score += 10;
+        }
+        
+        return score;
     }
     
-    inline int tapered(int mg, int eg, int phase) const {
-        return (mg * phase + eg * (24 - phase)) / 24;
+    const PawnEntry& probePawns(const Board& board) {
+        uint64_t key = board.pawnKey();
+        PawnEntry& entry = pawnTable[key & (PAWN_TABLE_SIZE - 1)];
+        if (entry.key == key) return entry;
+        
+        entry.key = key;
+        entry.mg = entry.eg = 0;
+        for (int c = 0; c < 2; ++c) {
+            Color color = static_cast<Color>(c);
+            Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
+            uint64_t pawns = board.getBitboard(PieceType::PAWN, color);
+            uint64_t enemyPawns = board.getBitboard(PieceType::PAWN, enemy);
+            
+            entry.attacks[c] = Attacks::pawnAttacks(color, pawns);
+            entry.attackSpan[c] = Attacks::frontFill(color, entry.attacks[c]);
+            
+            entry.passed[c] = 0;
+            for (uint64_t bb = pawns; bb; bb &= bb - 1) {
+                int sq = lsbIndex(bb);
+                if (!(Attacks::PASSED_PAWN[c][sq] & enemyPawns)) entry.passed[c] |= 1ULL << sq;
+            }
+            
+            Score structure = evaluatePawnStructure(pawns, color);
+            Score passed = evaluatePassedPawns(entry.passed[c], pawns, color);
+            int sign = (color == Color::WHITE) ? 1 : -1;
+            entry.mg += sign * (structure + passed);
+            entry.eg += sign * (structure + passed * 2);
+        }
+        return entry;
     }
     
-    inline int getPstValue(Square sq, PieceType pt, Color c, bool endgame) const {
-        int index = static_cast<int>(sq);
-        if (c == Color::BLACK) index = 63 - index;
+    const MaterialEntry& probeMaterial(const Board& board) {
+        uint64_t key = board.materialKey();
+        MaterialEntry& entry = materialTable[(key * 0x9E3779B97F4A7C15ULL) >> 51];
+        if (entry.key == key) return entry;
+        
+        entry.key = key;
+        std::array<std::array<int, 5>, 2> count;
+        std::array<int, 2> nonPawn = {0, 0};
+        int phase = 0;
+        for (int c = 0; c < 2; ++c) {
+            for (int p = 0; p < 5; ++p) {
+                count[c][p] = static_cast<int>((key >> (4 * (5 * c + p))) & 0xF);
+                phase += count[c][p] * Pst::PHASE[p];
+                if (p > 0) nonPawn[c] += count[c][p] * pieceValues[p];
+            }
+        }
+        entry.phase = std::min(24, phase);
         
-        switch (pt) {
-            case PieceType::PAWN:   return endgame ? pawnTableEg[index] : pawnTableMg[index];
-            case PieceType::KNIGHT: return knightTable[index];
-            case PieceType::BISHOP: return bishopTable[index];
-            case PieceType::ROOK:   return rookTable[index];
-            case PieceType::QUEEN:  return queenTable[index];
-            case PieceType::KING:   return endgame ? kingTableEg[index] : kingTableMg[index];
-            default: return 0;
+        entry.mg = entry.eg = 0;
+        for (int c = 0; c < 2; ++c) {
+            int sign = (c == 0) ? 1 : -1;
+            if (count[c][2] >= 2) {
+                entry.mg += sign * BISHOP_PAIR_BONUS;
+                entry.eg += sign * 40;
+            }
+            
+            // Without pawns, being up no more than a minor piece is rarely
+            // enough to win; with nothing better than a minor it never is.
+            int weak = 1 - c;
+            entry.scale[c] = 64;
+            if (count[c][0] == 0 && nonPawn[c] - nonPawn[weak] <= pieceValues[2]) {
+                entry.scale[c] = nonPawn[c] < pieceValues[3] ? 0 : (nonPawn[weak] <= pieceValues[2] ? 4 : 14);
+            }
         }
+        
+        entry.draw = count[0][0] == 0 && count[1][0] == 0 && nonPawn[0] + nonPawn[1] <= pieceValues[2];
+        return entry;
     }
     
-    Score evaluateMobility(const Board& board, Color color) const {
+    Score evaluateMobility(const Board& board, const PawnEntry& pawns, Color color) const {
         Score mobility = 0;
         uint64_t occupied = board.occupied();
         Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
         
-        uint64_t enemyPawns = board.getBitboard(PieceType::PAWN, enemy);
-        uint64_t safeSquares = ~board.getBitboard(PieceType::PAWN, color);
-        
-        if (enemy == Color::WHITE) {
-            safeSquares &= ~(((enemyPawns << 7) & ~0x0101010101010101ULL) | 
-                           ((enemyPawns << 9) & ~0x8080808080808080ULL));
-        } else {
-            safeSquares &= ~(((enemyPawns >> 7) & ~0x8080808080808080ULL) | 
-                           ((enemyPawns >> 9) & ~0x0101010101010101ULL));
-        }
+        uint64_t safeSquares = ~board.getBitboard(PieceType::PAWN, color) & 
+                               ~pawns.attacks[static_cast<int>(enemy)];
 
         uint64_t knights = board.getBitboard(PieceType::KNIGHT, color);
         while (knights) {
@@ -1401,58 +2084,6 @@ struct Evaluator {
         return mobility;
     }
 
-    Score evaluatePawnStructure(const Board& board, Color color) const {
-        Score score = 0;
-        uint64_t pawns = board.getBitboard(PieceType::PAWN, color);
-        
-        for (int file = 0; file < 8; ++file) {
-            uint64_t fileMask = 0x0101010101010101ULL << file;
-            uint64_t pawnsOnFile = pawns & fileMask;
-            int count = popcount(pawnsOnFile);
-
-            if (count > 1) {
-                score -= 15 * (count - 1);
-            }
-
-            if (count > 0) {
-                uint64_t adjacentFiles = 0;
-                if (file > 0) adjacentFiles |= 0x0101010101010101ULL << (file - 1);
-                if (file < 7) adjacentFiles |= 0x0101010101010101ULL << (file + 1);
-                
-                if ((pawns & adjacentFiles) == 0) {
-                    score -= 20;
-                }
-            }
-        }
-
-        uint64_t pawnsCopy = pawns;
-        while (pawnsCopy) {
-            int sq = lsbIndex(pawnsCopy);
-            pawnsCopy &= pawnsCopy - 1;
-            
-            int file = sq % 8;
-            int rank = sq / 8;
-
-            uint64_t connections = 0;
-            if (file > 0) {
-                connections |= (1ULL << (sq - 1));
-                if (color == Color::WHITE && rank < 7) connections |= (1ULL << (sq + 7));
-                if (color == Color::BLACK && rank > 0) connections |= (1ULL << (sq - 9));
-            }
-            if (file < 7) {
-                connections |= (1ULL << (sq + 1));
-                if (color == Color::WHITE && rank < 7) connections |= (1ULL << (sq + 9));
-                if (color == Color::BLACK && rank > 0) connections |= (1ULL << (sq - 7));
-            }
-            
-            if (pawns & connections) {
-                score += 8;
-            }
-        }
-        
-        return score;
-    }
-
     Score evaluateRooks(const Board& board, Color color) const {
         Score score = 0;
         uint64_t rooks = board.getBitboard(PieceType::ROOK, color);
@@ -1485,99 +2116,13 @@ struct Evaluator {
         return score;
     }
     
-    Score evaluateKnights(const Board& board, Color color) const {
-        Score score = 0;
-        uint64_t knights = board.getBitboard(PieceType::KNIGHT, color);
-        uint64_t ownPawns = board.getBitboard(PieceType::PAWN, color);
-        Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        uint64_t enemyPawns = board.getBitboard(PieceType::PAWN, enemy);
-        
-        while (knights) {
-            int sq = lsbIndex(knights);
-            knights &= knights - 1;
-            
-            int file = sq % 8;
-            int rank = sq / 8;
-
-            bool supported = false;
-            if (color == Color::WHITE && rank > 0) {
-                if (file > 0 && (ownPawns & (1ULL << (sq - 9)))) supported = true;
-                if (file < 7 && (ownPawns & (1ULL << (sq - 7)))) supported = true;
-            } else if (color == Color::BLACK && rank < 7) {
-                if (file > 0 && (ownPawns & (1ULL << (sq + 7)))) supported = true;
-                if (file < 7 && (ownPawns & (1ULL << (sq + 9)))) supported = true;
-            }
-            
-            if (supported) {
-                bool canBeAttacked = false;
-                if (color == Color::WHITE) {
-                    for (int r = rank - 1; r >= 0; --r) {
-                        if (file > 0 && (enemyPawns & (1ULL << (r * 8 + file - 1)))) canBeAttacked = true;
-                        if (file < 7 && (enemyPawns & (1ULL << (r * 8 + file + 1)))) canBeAttacked = true;
-                    }
-                } else {
-                    for (int r = rank + 1; r < 8; ++r) {
-                        if (file > 0 && (enemyPawns & (1ULL << (r * 8 + file - 1)))) canBeAttacked = true;
-                        if (file < 7 && (enemyPawns & (1ULL << (r * 8 + file + 1)))) canBeAttacked = true;
-                    }
-                }
-                
-                if (!canBeAttacked) {
-                    score += 25;
-                }
-            }
-        }
-        
-        return score;
-    }
-
-    Score evaluatePassedPawns(const Board& board, Color color) const {
-        Score score = 0;
-        uint64_t pawns = board.getBitboard(PieceType::PAWN, color);
+    // Outposts: knights defended by a pawn that no enemy pawn can ever chase away.
+    Score evaluateKnights(const Board& board, const PawnEntry& pawns, Color color) const {
         Color enemy = (color == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        uint64_t enemyPawns = board.getBitboard(PieceType::PAWN, enemy);
-        
-        while (pawns) {
-            int sq = lsbIndex(pawns);
-            pawns &= pawns - 1;
-            
-            int rank = sq / 8;
-            int file = sq % 8;
-            
-            uint64_t blockMask = 0;
-            if (color == Color::WHITE) {
-                for (int r = rank + 1; r < 8; ++r) {
-                    for (int f = std::max(0, file-1); f <= std::min(7, file+1); ++f) {
-                        blockMask |= (1ULL << (r * 8 + f));
-                    }
-                }
-            } else {
-                for (int r = rank - 1; r >= 0; --r) {
-                    for (int f = std::max(0, file-1); f <= std::min(7, file+1); ++f) {
-                        blockMask |= (1ULL << (r * 8 + f));
-                    }
-                }
-            }
-            
-            if ((enemyPawns & blockMask) == 0) {
-                int bonus = (color == Color::WHITE) ? (rank - 1) * 20 : (6 - rank) * 20;
-                score += bonus;
-
-                uint64_t ownPawns = board.getBitboard(PieceType::PAWN, color);
-                bool protected_pawn = false;
-                if (color == Color::WHITE && rank > 0) {
-                    if (file > 0 && (ownPawns & (1ULL << (sq - 9)))) protected_pawn = true;
-                    if (file < 7 && (ownPawns & (1ULL << (sq - 7)))) protected_pawn = true;
-                } else if (color == Color::BLACK && rank < 7) {
-                    if (file > 0 && (ownPawns & (1ULL << (sq + 7)))) protected_pawn = true;
-                    if (file < 7 && (ownPawns & (1ULL << (sq + 9)))) protected_pawn = true;
-                }
-                
-                if (protected_pawn) score += 10;
-            }
-        }
-        
-        return score;
+        uint64_t outposts = board.getBitboard(PieceType::KNIGHT, color) &
+                            pawns.attacks[static_cast<int>(color)] &
+                            ~pawns.attackSpan[static_cast<int>(enemy)];
+        return popcount(outposts) * 25;
     }
 
     Score evaluateKingSafety(const Board& board, Color color, int kingSq, int phase) const {
@@ -1627,61 +2172,44 @@ struct Evaluator {
         return safety;
     }
     
-    Score evaluate(const Board& board) const {
-        Score mgScore = 0, egScore = 0;
-        int phase = gamePhase(board);
-
-        for (const auto& [sq, piece] : board.pieceList()) {
-            if (piece.type == PieceType::NONE) continue;
-            
-            Score valueMg = pieceValues[static_cast<int>(piece.type)];
-            Score valueEg = pieceValues[static_cast<int>(piece.type)];
-            
-            valueMg += getPstValue(sq, piece.type, piece.color, false);
-            valueEg += getPstValue(sq, piece.type, piece.color, true);
-            
-            if (piece.color == Color::WHITE) {
-                mgScore += valueMg;
-                egScore += valueEg;
-            } else {
-                mgScore -= valueMg;
-                egScore -= valueEg;
-            }
-        }
-
-        if (popcount(board.getBitboard(PieceType::BISHOP, Color::WHITE)) >= 2) {
-            mgScore += 30;
-            egScore += 40;
-        }
-        if (popcount(board.getBitboard(PieceType::BISHOP, Color::BLACK)) >= 2) {
-            mgScore -= 30;
-            egScore -= 40;
-        }
+    Score evaluate(const Board& board) {
+        return evaluate(board, -INT_MAX, INT_MAX);
+    }
+    
+    // Material, PST and the hashed pawn terms are nearly free; if they already
+    // put the score LAZY_MARGIN outside [alpha, beta], the remaining terms are
+    // skipped. The margin is a heuristic, not a bound: the skipped terms can
+    // add up to more than 400 in the middlegame, they just rarely do.
+    Score evaluate(const Board& board, Score alpha, Score beta) {
+        const MaterialEntry& material = probeMaterial(board);
+        if (material.draw) return 0;
+        if (Nnue::active) return Nnue::evaluate(board.accumulator(), board.turn());
+        
+        Score mgScore = board.mgScore() + material.mg, egScore = board.egScore() + material.eg;
+        int phase = material.phase;
 
-        Score whiteMobility = evaluateMobility(board, Color::WHITE);
-        Score blackMobility = evaluateMobility(board, Color::BLACK);
+        const PawnEntry& pawns = probePawns(board);
+        mgScore += pawns.mg;
+        egScore += pawns.eg;
+        
+        Score lazy = tapered(mgScore, egScore * material.scale[egScore > 0 ? 0 : 1] / 64, phase) + 10;
+        if (board.turn() == Color::BLACK) lazy = -lazy;
+        if (lazy - LAZY_MARGIN >= beta || lazy + LAZY_MARGIN <= alpha) return lazy;
+        
+        Score whiteMobility = evaluateMobility(board, pawns, Color::WHITE);
+        Score blackMobility = evaluateMobility(board, pawns, Color::BLACK);
         mgScore += (whiteMobility - blackMobility);
         egScore += (whiteMobility - blackMobility) / 2;
 
-        Score whitePawns = evaluatePawnStructure(board, Color::WHITE);
-        Score blackPawns = evaluatePawnStructure(board, Color::BLACK);
-        mgScore += (whitePawns - blackPawns);
-        egScore += (whitePawns - blackPawns);
-
         Score whiteRooks = evaluateRooks(board, Color::WHITE);
         Score blackRooks = evaluateRooks(board, Color::BLACK);
         mgScore += (whiteRooks - blackRooks);
         egScore += (whiteRooks - blackRooks);
 
-        Score whiteKnights = evaluateKnights(board, Color::WHITE);
-        Score blackKnights = evaluateKnights(board, Color::BLACK);
+        Score whiteKnights = evaluateKnights(board, pawns, Color::WHITE);
+        Score blackKnights = evaluateKnights(board, pawns, Color::BLACK);
         mgScore += (whiteKnights - blackKnights);
 
-        Score whitePassedPawns = evaluatePassedPawns(board, Color::WHITE);
-        Score blackPassedPawns = evaluatePassedPawns(board, Color::BLACK);
-        mgScore += (whitePassedPawns - blackPassedPawns);
-        egScore += (whitePassedPawns - blackPassedPawns) * 2;
-
         uint64_t whiteKing = board.getBitboard(PieceType::KING, Color::WHITE);
         uint64_t blackKing = board.getBitboard(PieceType::KING, Color::BLACK);
         if (whiteKing) {
@@ -1693,6 +2221,7 @@ struct Evaluator {
             mgScore -= evaluateKingSafety(board, Color::BLACK, kingSq, phase);
         }
 
+        egScore = egScore * material.scale[egScore > 0 ? 0 : 1] / 64;
         Score score = tapered(mgScore, egScore, phase);
 
         score += 10;
@@ -1708,180 +2237,494 @@ constexpr Depth MAX_KILLER_DEPTH = 30;
 constexpr Depth MAX_QUIESCENCE_PLY = 30;
 constexpr Score FUTILITY_MARGIN = 100;
 constexpr Score RAZORING_MARGIN = 200;
+constexpr Score ASPIRATION_DELTA = 50;
+constexpr Score ASPIRATION_MAX_DELTA = 500;  // beyond this the failing side opens fully
+constexpr Depth ASPIRATION_MIN_DEPTH = 5;
+
+// Whether a reported root score is exact or only a bound from a failed
+// aspiration search.
+enum class ScoreBound { EXACT, LOWER, UPPER };
 
 struct SearchStats {
-    int64_t nodes = 0;
-    int64_t qNodes = 0;
+    // Written by the owning thread only; atomic so the main thread can sum
+    // them across threads while the search runs.
+    std::atomic<int64_t> nodes{0};
+    std::atomic<int64_t> qNodes{0};
     std::chrono::steady_clock::time_point startTime;
     Depth depth = 0;
     int seldepth = 0; 
     int64_t maxTimeMs = INT64_MAX;
-    std::atomic<bool> stopSearch{false};
+    std::atomic<bool>* stopSearch = nullptr;  // shared by every thread of a search
     
-    void start(int64_t maxTime = INT64_MAX) {
+    // Aspiration window instrumentation: root searches started, how many
+    // failed on each side, and the nodes those failed searches cost.
+    int aspirationSearches = 0;
+    int aspirationFailHighs = 0;
+    int aspirationFailLows = 0;
+    int64_t aspirationWastedNodes = 0;
+    
+    void start(std::atomic<bool>* stop, int64_t maxTime = INT64_MAX) {
         nodes = 0;
         qNodes = 0;
         seldepth = 0;
+        aspirationSearches = 0;
+        aspirationFailHighs = 0;
+        aspirationFailLows = 0;
+        aspirationWastedNodes = 0;
         maxTimeMs = maxTime;
-        stopSearch = false;
+        stopSearch = stop;
         startTime = std::chrono::steady_clock::now();
     }
     
-    void addNode(bool quiescence = false) {
-        if (quiescence) qNodes++;
-        else nodes++;
+    void addNode(bool quiescence = false) {
+        std::atomic<int64_t>& counter = quiescence ? qNodes : nodes;
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    
+    int64_t totalNodes() const {
+        return nodes.load(std::memory_order_relaxed) + qNodes.load(std::memory_order_relaxed);
+    }
+    
+    int64_t timeMs() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - startTime).count();
+    }
+    
+    bool checkTime() {
+        if (stopSearch->load(std::memory_order_relaxed)) return true;
+        if (maxTimeMs == INT64_MAX) return false;
+        
+        if ((totalNodes() & 0x7F) != 0) return false;
+        
+        if (timeMs() >= maxTimeMs) {
+            stopSearch->store(true, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+};
+
+// Transposition Table
+// Shared by all search threads and accessed without locks. An entry is two
+// words: the packed data and the key XORed with it. A write torn by another
+// thread leaves the pair inconsistent, so the entry simply fails to match.
+// Four entries fill a 64-byte cluster, one cache line per probe.
+constexpr Score NO_EVAL = 32001;
+
+struct TTData {
+    uint16_t move = 0;
+    Score score = 0;
+    Score eval = NO_EVAL;
+    Depth depth = 0;
+    uint8_t flag = 0;  // 1 exact, 2 lower bound, 3 upper bound
+};
+
+class TranspositionTable {
+private:
+    // data bits: 0-15 move, 16-31 score, 32-47 static eval, 48-55 depth,
+    // 56-57 bound, 58-63 generation. 0 means empty.
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data{0};
+    };
+    
+    struct alignas(64) Cluster {
+        std::array<Entry, 4> entries;
+    };
+    
+    struct FreeDeleter {
+        void operator()(Cluster* p) const { std::free(p); }
+    };
+    
+    std::unique_ptr<Cluster, FreeDeleter> clusters_;
+    size_t clusterCount_ = 0;
+    size_t megabytes_;
+    uint8_t generation_ = 0;
+    
+    static uint64_t pack(uint16_t move, Score score, Score eval, Depth depth, uint8_t flag, uint8_t generation) {
+        return move |
+               static_cast<uint64_t>(static_cast<uint16_t>(score)) << 16 |
+               static_cast<uint64_t>(static_cast<uint16_t>(eval)) << 32 |
+               static_cast<uint64_t>(std::clamp(depth, 0, 255)) << 48 |
+               static_cast<uint64_t>(flag & 3) << 56 |
+               static_cast<uint64_t>(generation & 63) << 58;
+    }
+    
+    static Depth depthOf(uint64_t data) { return (data >> 48) & 0xFF; }
+    static uint8_t generationOf(uint64_t data) { return data >> 58; }
+    
+    // Touching a multi-GB table is slow, so it is split across threads.
+    template <typename Fn>
+    void forEachChunk(int threads, Fn fn) const {
+        threads = std::max(1, threads);
+        size_t chunk = (clusterCount_ + threads - 1) / threads;
+        auto run = [&](int i) {
+            size_t begin = std::min(clusterCount_, i * chunk);
+            fn(begin, std::min(clusterCount_, begin + chunk));
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i) pool.emplace_back(run, i);
+        run(0);
+        for (auto& t : pool) t.join();
+    }
+    
+    Cluster& cluster(uint64_t key) {
+        return clusters_.get()[static_cast<size_t>((static_cast<unsigned __int128>(key) * clusterCount_) >> 64)];
     }
     
-    int64_t nps() const {
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - startTime).count();
-        return (nodes + qNodes) * 1000 / std::max<int64_t>(ms, 1);
+public:
+    explicit TranspositionTable(size_t megabytes) : megabytes_(megabytes) {}
+    
+    // Takes effect at the next allocate().
+    void resize(size_t megabytes) {
+        megabytes_ = std::max<size_t>(1, megabytes);
+        clusters_.reset();
+        clusterCount_ = 0;
+    }
+    
+    // Allocated on the first isready, ucinewgame or go rather than at
+    // startup, so the GUI does not wait on it at launch. The block is 2 MB
+    // aligned and a whole number of 2 MB pages, so Linux can back it with
+    // transparent huge pages; on failure the size is halved until it fits.
+    void allocate(int threads) {
+        if (clusters_) return;
+        constexpr size_t PAGE = 2 * 1024 * 1024;
+        size_t bytes = megabytes_ * 1024 * 1024;
+        void* memory = nullptr;
+        while (!memory) {
+            memory = std::aligned_alloc(PAGE, (bytes + PAGE - 1) / PAGE * PAGE);
+            if (!memory) {
+                if (bytes <= PAGE) throw std::bad_alloc();
+                bytes /= 2;
+                std::cerr << "Warning: TT allocation failed, trying " << bytes / (1024 * 1024) << " MB" << std::endl;
+            }
+        }
+#if defined(__linux__)
+        madvise(memory, (bytes + PAGE - 1) / PAGE * PAGE, MADV_HUGEPAGE);
+#endif
+        clusterCount_ = bytes / sizeof(Cluster);
+        // Constructing the clusters zeroes them and faults the pages in.
+        forEachChunk(threads, [memory](size_t begin, size_t end) {
+            new (static_cast<Cluster*>(memory) + begin) Cluster[end - begin];
+        });
+        clusters_.reset(static_cast<Cluster*>(memory));
     }
     
-    int64_t timeMs() const {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - startTime).count();
+    void clear(int threads) {
+        if (!clusters_) return;
+        forEachChunk(threads, [this](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                for (Entry& e : clusters_.get()[i].entries) {
+                    e.check.store(0, std::memory_order_relaxed);
+                    e.data.store(0, std::memory_order_relaxed);
+                }
+            }
+        });
     }
     
-    bool checkTime() {
-        if (stopSearch.load(std::memory_order_relaxed)) return true;
-        if (maxTimeMs == INT64_MAX) return false;
-        
-        if (((nodes + qNodes) & 0x7F) != 0) return false;
-        
-        if (timeMs() >= maxTimeMs) {
-            stopSearch.store(true, std::memory_order_relaxed);
-            return true;
+    void newSearch() { generation_ = (generation_ + 1) & 63; }
+    
+    void prefetch(uint64_t key) {
+        __builtin_prefetch(&cluster(key));
+    }
+    
+    bool probe(uint64_t key, TTData& out) {
+        for (const Entry& e : cluster(key).entries) {
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if (data && (e.check.load(std::memory_order_relaxed) ^ data) == key) {
+                out.move = data & 0xFFFF;
+                out.score = static_cast<int16_t>(data >> 16);
+                out.eval = static_cast<int16_t>(data >> 32);
+                out.depth = depthOf(data);
+                out.flag = (data >> 56) & 3;
+                return true;
+            }
         }
         return false;
     }
+    
+    // Same position: keep the old entry only if it is from this search and
+    // deeper. Otherwise replace the shallowest entry, counting every search
+    // it has survived as eight plies less depth.
+    void store(uint64_t key, Move move, Score score, Score eval, Depth depth, uint8_t flag) {
+        Entry* replace = nullptr;
+        uint16_t compact = move.compact();
+        int worst = INT_MAX;
+        for (Entry& e : cluster(key).entries) {
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if (!data || (e.check.load(std::memory_order_relaxed) ^ data) == key) {
+                if (data && generationOf(data) == generation_ && depthOf(data) > depth && flag != 1) return;
+                if (data && !compact) compact = data & 0xFFFF;
+                replace = &e;
+                break;
+            }
+            int value = depthOf(data) - 8 * ((generation_ - generationOf(data)) & 63);
+            if (value < worst) {
+                worst = value;
+                replace = &e;
+            }
+        }
+        uint64_t data = pack(compact, score, eval, depth, flag, generation_);
+        replace->data.store(data, std::memory_order_relaxed);
+        replace->check.store(key ^ data, std::memory_order_relaxed);
+    }
+    
+    // Entries written by the current search, per thousand, from a sample.
+    int hashfull() const {
+        int used = 0;
+        const size_t sampleSize = std::min<size_t>(clusterCount_, 250);
+        for (size_t i = 0; i < sampleSize; ++i) {
+            for (const Entry& e : clusters_.get()[i].entries) {
+                uint64_t data = e.data.load(std::memory_order_relaxed);
+                if (data && generationOf(data) == generation_) used++;
+            }
+        }
+        return static_cast<int>(used * 1000 / (sampleSize * 4));
+    }
 };
 
+// One search thread. Each has a private board, evaluator caches, killers
+// and history; only the transposition table and the stop flag are shared.
 class Searcher {
 private:
-    Board& board;
+    Board board;
     Evaluator eval;
-    std::array<std::array<std::optional<Move>, 2>, MAX_KILLER_DEPTH> killers_;
+    std::array<std::array<Move, 2>, MAX_KILLER_DEPTH> killers_;
     std::array<std::array<int, 64>, 64> history_;
     SearchStats stats;
+    TranspositionTable& tt;
+    int id_;
+    
+    std::optional<Move> bestMove_;
+    Score bestScore_ = 0;
+    Depth completedDepth_ = 0;
+    int rootPly_ = 0;
+    
+    // Triangular PV table: row ply holds the best line from that ply on,
+    // up to pvLength_[ply]. pv_ is the root line of the last completed depth.
+    std::array<std::array<Move, MAX_PLY>, MAX_PLY> pvTable_;
+    std::array<int, MAX_PLY> pvLength_{};
+    std::vector<Move> pv_;
+    
+    // The TT outlives a single search, so mate scores are stored as distance
+    // from the node rather than from the root.
+    static Score scoreToTT(Score score, Depth ply) {
+        if (score >= INFINITY_SCORE - MAX_PLY) return score + ply;
+        if (score <= -INFINITY_SCORE + MAX_PLY) return score - ply;
+        return score;
+    }
     
-    struct TTEntry {
-        uint64_t key = 0;
-        Move move;
-        Score score = 0;
-        Depth depth = 0;
-        uint8_t flag = 0;
-    };
-    std::vector<TTEntry> tt;
-    const uint64_t ttSize = 1 << 21;
+    static Score scoreFromTT(Score score, Depth ply) {
+        if (score >= INFINITY_SCORE - MAX_PLY) return score - ply;
+        if (score <= -INFINITY_SCORE + MAX_PLY) return score + ply;
+        return score;
+    }
     
-    void clearTT() { std::fill(tt.begin(), tt.end(), TTEntry()); }
+    int mvvLvaScore(const Move& move) const {
+        if (!move.isCapture()) return 0;
+        return eval.pieceValues[static_cast<int>(move.captured())] * 10 - 
+               eval.pieceValues[static_cast<int>(move.moved())];
+    }
     
-    void storeTT(uint64_t key, Move move, Score score, Depth depth, uint8_t flag) {
-        TTEntry& entry = tt[key % tt.size()];
-        if (depth >= entry.depth || entry.key == 0) {
-            entry.key = key; entry.move = move; entry.score = score;
-            entry.depth = depth; entry.flag = flag;
-        }
+    void updatePv(const Move& move, Depth ply) {
+        if (ply + 1 >= MAX_PLY) return;
+        auto& row = pvTable_[ply];
+        const auto& child = pvTable_[ply + 1];
+        row[ply] = move;
+        std::copy(child.begin() + ply + 1, child.begin() + pvLength_[ply + 1], row.begin() + ply + 1);
+        pvLength_[ply] = pvLength_[ply + 1];
     }
     
-    int mvvLvaScore(const Move& move) const {
-        if (!board.isCapture(move)) return 0;
-        auto victim = board.pieceAt(move.to);
-        auto aggressor = board.pieceAt(move.from);
-        if (victim.type != PieceType::NONE && aggressor.type != PieceType::NONE) {
-            return eval.pieceValues[static_cast<int>(victim.type)] * 10 - 
-                   eval.pieceValues[static_cast<int>(aggressor.type)];
-        }
-        return 0;
+    // Once the search is stopped every score coming back up is meaningless:
+    // nodes return at once, without touching the TT, killers or history,
+    // and callers discard the result.
+    bool stopped() const {
+        return stats.stopSearch->load(std::memory_order_relaxed);
     }
     
-    int scoreMove(const Move& move, Depth ply, uint64_t hash) {
-        Color us = board.turn();
-        Color them = (us == Color::WHITE) ? Color::BLACK : Color::WHITE;
-        
-        const TTEntry* entry = &tt[hash % tt.size()];
-        if (entry->key == hash && entry->move == move) return 200000;
-        
+    bool isKiller(const Move& move, Depth ply) const {
+        return ply < MAX_KILLER_DEPTH && (killers_[ply][0] == move || killers_[ply][1] == move);
+    }
+    
+    int scoreMove(const Move& move, const AttackInfo& info, Depth ply) {
         int captureScore = mvvLvaScore(move);
         if (captureScore != 0) return 100000 + captureScore;
         
-        if (move.promotion != PieceType::NONE) {
-            return 90000 + eval.pieceValues[static_cast<int>(move.promotion)];
+        if (move.isPromotion()) {
+            return 90000 + eval.pieceValues[static_cast<int>(move.promotion())];
         }
         
-        bool givesCheck = false;
-        
-        uint64_t kings = board.getBitboard(PieceType::KING, them);
-        if (kings == 0) return 0;
-        
-        int enemyKingSq = lsbIndex(kings);
-        uint64_t kingMask = 1ULL << enemyKingSq;
-
-        PieceType pt = board.pieceAt(move.from).type;
-        uint64_t occ = board.occupied();
+        bool givesCheck = (info.checkSquares[static_cast<int>(move.moved())] >> static_cast<int>(move.to())) & 1;
+        if (givesCheck) return 250000;
         
-        switch (pt) {
-            case PieceType::KNIGHT:
-                givesCheck = (Attacks::knightAttacks(move.to) & kingMask) != 0;
-                break;
-            case PieceType::BISHOP:
-                givesCheck = (Attacks::bishopAttacks(move.to, occ) & kingMask) != 0;
-                break;
-            case PieceType::ROOK:
-                givesCheck = (Attacks::rookAttacks(move.to, occ) & kingMask) != 0;
-                break;
-            case PieceType::QUEEN:
-                givesCheck = (Attacks::queenAttacks(move.to, occ) & kingMask) != 0;
-                break;
-            case PieceType::KING:
-                givesCheck = false;
-                break;
-            case PieceType::PAWN: {
-                int epSq = static_cast<int>(move.to);
-                if (us == Color::WHITE) {
-                    if ((epSq + 7 == enemyKingSq && (epSq % 8) > 0) || 
-                        (epSq + 9 == enemyKingSq && (epSq % 8) < 7)) {
-                        givesCheck = true;
-                    }
-                } else {
-                    if ((epSq - 7 == enemyKingSq && (epSq % 8) < 7) || 
-                        (epSq - 9 == enemyKingSq && (epSq % 8) > 0)) {
-                        givesCheck = true;
-                    }
-                }
-                break;
+        if (ply < MAX_KILLER_DEPTH) {
+            if (killers_[ply][0] == move) return 50000;
+            if (killers_[ply][1] == move) return 40000;
+        }
+        
+        return history_[static_cast<int>(move.from())][static_cast<int>(move.to())];
+    }
+    
+    // Hands out moves one at a time so that a cutoff on an early move skips
+    // generating and scoring the rest: TT move, good captures by MVV-LVA,
+    // killers, quiets, then captures that lose material. Evasions are
+    // generated in one go.
+    class MovePicker {
+    private:
+        enum class Stage { TT_MOVE, GEN_CAPTURES, GOOD_CAPTURES, KILLERS, GEN_QUIETS, QUIETS,
+                           BAD_CAPTURES, GEN_EVASIONS, EVASIONS, DONE };
+        
+        Searcher& s;
+        const AttackInfo& info;
+        Depth ply;
+        Move ttMove;
+        bool quiescence;
+        Stage stage;
+        MoveList moves;
+        std::array<int, MAX_MOVES> scores;
+        int cur = 0;
+        int badCount = 0;
+        int killerIndex = 0;
+        
+        Move& pickBest() {
+            int best = cur;
+            for (int i = cur + 1; i < moves.size(); ++i) {
+                if (scores[i] > scores[best]) best = i;
             }
-            default:
-                givesCheck = false;
+            std::swap(moves[cur], moves[best]);
+            std::swap(scores[cur], scores[best]);
+            return moves[cur++];
         }
         
-        if (givesCheck) return 250000;
+        bool isLosingCapture(const Move& move) const {
+            if (!move.isCapture() || 
+                s.eval.pieceValues[static_cast<int>(move.captured())] >= s.eval.pieceValues[static_cast<int>(move.moved())]) {
+                return false;
+            }
+            Color them = (s.board.turn() == Color::WHITE) ? Color::BLACK : Color::WHITE;
+            return s.board.isAttackedBy(move.to(), them);
+        }
         
-        if (ply < MAX_KILLER_DEPTH) {
-            if (killers_[ply][0] && *killers_[ply][0] == move) return 50000;
-            if (killers_[ply][1] && *killers_[ply][1] == move) return 40000;
+        static bool isCaptureStageMove(const Move& move) {
+            return move.isCapture() || move.promotion() == PieceType::QUEEN;
         }
         
-        return history_[static_cast<int>(move.from)][static_cast<int>(move.to)];
-    }
-    
-    std::vector<Move> orderMoves(const std::vector<Move>& moves, Depth ply, uint64_t hash) {
-        if (stats.stopSearch.load(std::memory_order_relaxed)) return {};
-         
-        std::vector<std::pair<int, Move>> scored;
-        scored.reserve(moves.size());
-        for (const auto& move : moves) {
-            scored.emplace_back(scoreMove(move, ply, hash), move);
+    public:
+        MovePicker(Searcher& searcher, const AttackInfo& attackInfo, Depth p, const Move& tt, bool qsearch)
+            : s(searcher), info(attackInfo), ply(p), ttMove(tt), quiescence(qsearch) {
+            if (info.checkers) {
+                stage = Stage::GEN_EVASIONS;
+            } else if (s.board.isLegal(ttMove, info) && (!quiescence || isCaptureStageMove(ttMove))) {
+                stage = Stage::TT_MOVE;
+            } else {
+                stage = Stage::GEN_CAPTURES;
+                ttMove = Move();
+            }
         }
-        std::sort(scored.begin(), scored.end(),
-            [](const auto& a, const auto& b) { return a.first > b.first; });
         
-        std::vector<Move> ordered;
-        ordered.reserve(moves.size());
-        for (const auto& p : scored) ordered.push_back(p.second);
-        return ordered;
-    }
+        bool next(Move& out) {
+            switch (stage) {
+                case Stage::TT_MOVE:
+                    stage = Stage::GEN_CAPTURES;
+                    out = ttMove;
+                    return true;
+                    
+                case Stage::GEN_CAPTURES:
+                    moves = s.board.generateCaptures(info);
+                    for (int i = 0; i < moves.size(); ++i) {
+                        scores[i] = s.mvvLvaScore(moves[i]);
+                        if (moves[i].isPromotion()) {
+                            scores[i] += s.eval.pieceValues[static_cast<int>(moves[i].promotion())] * 10;
+                        }
+                    }
+                    cur = badCount = 0;
+                    stage = Stage::GOOD_CAPTURES;
+                    [[fallthrough]];
+                    
+                case Stage::GOOD_CAPTURES:
+                    while (cur < moves.size()) {
+                        Move& move = pickBest();
+                        if (move == ttMove) continue;
+                        if (isLosingCapture(move)) {
+                            moves[badCount++] = move;
+                            continue;
+                        }
+                        out = move;
+                        return true;
+                    }
+                    stage = quiescence ? Stage::BAD_CAPTURES : Stage::KILLERS;
+                    if (quiescence) {
+                        cur = 0;
+                        return next(out);
+                    }
+                    [[fallthrough]];
+                    
+                case Stage::KILLERS:
+                    while (ply < MAX_KILLER_DEPTH && killerIndex < 2) {
+                        const Move& killer = s.killers_[ply][killerIndex++];
+                        if (killer != ttMove && !isCaptureStageMove(killer) && s.board.isLegal(killer, info)) {
+                            out = killer;
+                            return true;
+                        }
+                    }
+                    stage = Stage::GEN_QUIETS;
+                    [[fallthrough]];
+                    
+                case Stage::GEN_QUIETS:
+                    // Losing captures stay parked in moves[0, badCount).
+                    moves.resize(badCount);
+                    for (const Move& move : s.board.generateQuiets(info)) {
+                        scores[moves.size()] = s.scoreMove(move, info, ply);
+                        moves.push_back(move);
+                    }
+                    cur = badCount;
+                    stage = Stage::QUIETS;
+                    [[fallthrough]];
+                    
+                case Stage::QUIETS:
+                    while (cur < moves.size()) {
+                        Move& move = pickBest();
+                        if (move == ttMove || s.isKiller(move, ply)) continue;
+                        out = move;
+                        return true;
+                    }
+                    cur = 0;
+                    stage = Stage::BAD_CAPTURES;
+                    [[fallthrough]];
+                    
+                case Stage::BAD_CAPTURES:
+                    if (cur < badCount) {
+                        out = moves[cur++];
+                        return true;
+                    }
+                    stage = Stage::DONE;
+                    return false;
+                    
+                case Stage::GEN_EVASIONS:
+                    moves = s.board.generateEvasions(info);
+                    for (int i = 0; i < moves.size(); ++i) {
+                        int captureScore = s.mvvLvaScore(moves[i]);
+                        if (moves[i] == ttMove) scores[i] = INT_MAX;
+                        else if (captureScore != 0) scores[i] = 100000 + captureScore;
+                        else scores[i] = s.scoreMove(moves[i], info, ply);
+                    }
+                    cur = 0;
+                    stage = Stage::EVASIONS;
+                    [[fallthrough]];
+                    
+                case Stage::EVASIONS:
+                    if (cur < moves.size()) {
+                        out = pickBest();
+                        return true;
+                    }
+                    stage = Stage::DONE;
+                    return false;
+                    
+                default:
+                    return false;
+            }
+        }
+    };
     
     Score quiescence(Score alpha, Score beta, Depth ply) {
         stats.addNode(true);
@@ -1889,31 +2732,49 @@ private:
         
         if (stats.checkTime()) return alpha;
 		
-		if (board.isDraw()) return 0;
+		if (board.isDrawByRule(ply)) return 0;
+        
+        if (alpha < 0 && board.hasUpcomingRepetition(ply)) {
+            alpha = 0;
+            if (alpha >= beta) return alpha;
+        }
+        
+        uint64_t hash = board.hash();
+        TTData tte;
+        bool ttHit = tt.probe(hash, tte);
         
-        bool inCheck = board.isInCheck(board.turn());
-        Score standPat = eval.evaluate(board);
+        AttackInfo info = board.computeAttackInfo();
+        bool inCheck = info.checkers != 0;
+        Score standPat = (ttHit && tte.eval != NO_EVAL) ? tte.eval : eval.evaluate(board, alpha, beta);
         
+        // A stalemate has no captures either, so it only needs telling apart
+        // from a quiet position where this node returns without searching.
         if (!inCheck) {
-            if (standPat >= beta) return beta;
+            if (standPat >= beta) return board.hasAnyLegalMove(info) ? beta : 0;
             if (alpha < standPat) alpha = standPat;
         }
         
-        if (ply >= MAX_QUIESCENCE_PLY) return alpha;
+        if (ply >= MAX_QUIESCENCE_PLY) return (inCheck || board.hasAnyLegalMove(info)) ? alpha : 0;
         
-        auto moves = inCheck ? board.generateMoves() : board.generateCaptures();
-        if (moves.empty()) return inCheck ? -INFINITY_SCORE + ply : standPat;
+        MovePicker picker(*this, info, ply, ttHit ? board.decodeMove(tte.move) : Move(), true);
         
-        auto ordered = orderMoves(moves, ply, board.computeHash());
-        for (const auto& move : ordered) {
-            if (stats.stopSearch.load(std::memory_order_relaxed)) break;
+        Move move;
+        int legalMoves = 0;
+        while (picker.next(move)) {
+            ++legalMoves;
             
             board.makeMove(move);
+            tt.prefetch(board.hash());
             Score score = -quiescence(-beta, -alpha, ply + 1);
             board.unmakeMove();
+            if (stopped()) return 0;
             if (score >= beta) return beta;
             if (score > alpha) alpha = score;
         }
+        if (legalMoves == 0) {
+            if (inCheck) return -INFINITY_SCORE + ply;
+            return board.hasAnyLegalMove(info) ? standPat : 0;
+        }
         return alpha;
     }
     
@@ -1921,35 +2782,48 @@ private:
         stats.addNode();
         stats.seldepth = std::max(stats.seldepth, ply);
         
+        if (ply < MAX_PLY) pvLength_[ply] = ply;
+        
         if (stats.checkTime()) return {alpha, std::nullopt};
         
         if (depth <= 0) return {quiescence(alpha, beta, ply), std::nullopt};
         
-        bool inCheck = board.isInCheck(board.turn());
+        bool pvNode = beta - alpha > 1;
+        
+        // The side to move can force a repetition, so it scores at least a draw.
+        if (alpha < 0 && board.hasUpcomingRepetition(ply)) {
+            alpha = 0;
+            if (alpha >= beta) return {alpha, std::nullopt};
+        }
+        
+        AttackInfo info = board.computeAttackInfo();
+        bool inCheck = info.checkers != 0;
         if (inCheck) depth++;
         
-        uint64_t hash = board.computeHash();
+        uint64_t hash = board.hash();
         
-        TTEntry* entry = &tt[hash % tt.size()];
-        if (entry->key == hash && entry->depth >= depth) {
-            if (entry->flag == 1) return {entry->score, entry->move};
-            if (entry->flag == 2 && entry->score >= beta) return {beta, entry->move};
-            if (entry->flag == 3 && entry->score <= alpha) return {alpha, entry->move};
+        // No cutoffs in PV nodes, which keeps the PV intact and means the
+        // root never takes another thread's move over one it searched.
+        TTData tte;
+        bool ttHit = tt.probe(hash, tte);
+        if (!pvNode && ttHit && tte.depth >= depth) {
+            Score ttScore = scoreFromTT(tte.score, ply);
+            if (tte.flag == 1) return {ttScore, board.decodeMove(tte.move)};
+            if (tte.flag == 2 && ttScore >= beta) return {beta, board.decodeMove(tte.move)};
+            if (tte.flag == 3 && ttScore <= alpha) return {alpha, board.decodeMove(tte.move)};
         }
         
-		if (board.isGameOver()) {
-			if (board.isCheckmate()) {
-				return {-INFINITY_SCORE + ply, std::nullopt};
-			}
+        // Mate and stalemate are found by the move loop; only mate overrides
+        // the fifty-move rule, and a stalemated side must not pass.
+		if (board.isDrawByRule(ply) && (!inCheck || board.hasAnyLegalMove(info))) {
 			return {0, std::nullopt};
 		}
         
-        Score standPat = eval.evaluate(board);
-        
-        if (depth >= 3 && !inCheck && board.hasNonPawnMaterial(board.turn())) {
+        if (depth >= 3 && !inCheck && board.hasNonPawnMaterial(board.turn()) && board.hasAnyLegalMove(info)) {
             board.makeNullMove();
             auto [nullScore, _] = negamax(depth - 3, -beta, -beta + 1, ply + 1);
             board.unmakeNullMove();
+            if (stopped()) return {0, std::nullopt};
             if (-nullScore >= beta) return {beta, std::nullopt};
         }
         
@@ -1957,21 +2831,24 @@ private:
         std::optional<Move> bestMove;
         Score alphaOrig = alpha;
         
-        bool canFutilityPrune = (depth == 1 && !inCheck && standPat + FUTILITY_MARGIN < alpha);
-        
-        auto moves = board.generateMoves();
-        if (moves.empty()) {
-            return {board.isInCheck(board.turn()) ? -INFINITY_SCORE + ply : 0, std::nullopt};
+        // The static eval is only needed for futility pruning; once computed
+        // it goes into the TT so quiescence can reuse it.
+        Score staticEval = NO_EVAL;
+        if (depth == 1 && !inCheck) {
+            staticEval = (ttHit && tte.eval != NO_EVAL) ? tte.eval : eval.evaluate(board, -INT_MAX, INT_MAX);
         }
+        bool canFutilityPrune = staticEval != NO_EVAL && staticEval < alpha - FUTILITY_MARGIN;
         
-        auto ordered = orderMoves(moves, ply, hash);
+        MovePicker picker(*this, info, ply, ttHit ? board.decodeMove(tte.move) : Move(), false);
+        Move move;
+        int legalMoves = 0;
         int moveCount = 0;
         
-        for (const auto& move : ordered) {
-            if (stats.stopSearch.load(std::memory_order_relaxed)) break;
+        while (picker.next(move)) {
+            ++legalMoves;
             
-            bool isCapture = board.isCapture(move);
-            bool isPromotion = (move.promotion != PieceType::NONE);
+            bool isCapture = move.isCapture();
+            bool isPromotion = move.isPromotion();
             
             if (canFutilityPrune && !isCapture && !isPromotion) {
                 continue;
@@ -1983,20 +2860,25 @@ private:
             }
             
             board.makeMove(move);
+            tt.prefetch(board.hash());
             Score score;
             
-            if (reduction > 0) {
-                auto [reducedScore, _] = negamax(depth - reduction - 1, -beta, -alpha, ply + 1);
-                score = -reducedScore;
-                if (score > alpha) {
-                    auto [fullScore, _] = negamax(depth - 1, -beta, -alpha, ply + 1);
-                    score = -fullScore;
-                }
+            // PVS: the first move gets the full window, the rest a null-window
+            // scout that is re-searched (unreduced, then full window) only if
+            // it beats alpha.
+            if (moveCount == 0) {
+                score = -negamax(depth - 1, -beta, -alpha, ply + 1).first;
             } else {
-                auto [searchScore, _] = negamax(depth - 1, -beta, -alpha, ply + 1);
-                score = -searchScore;
+                score = -negamax(depth - reduction - 1, -alpha - 1, -alpha, ply + 1).first;
+                if (score > alpha && reduction > 0) {
+                    score = -negamax(depth - 1, -alpha - 1, -alpha, ply + 1).first;
+                }
+                if (score > alpha && score < beta) {
+                    score = -negamax(depth - 1, -beta, -alpha, ply + 1).first;
+                }
             }
             board.unmakeMove();
+            if (stopped()) return {0, std::nullopt};
             
             moveCount++;
             
@@ -2007,8 +2889,9 @@ private:
             
             if (score > alpha) {
                 alpha = score;
+                updatePv(move, ply);
                 if (!isCapture && ply < MAX_KILLER_DEPTH) {
-                    if (!killers_[ply][0] || *killers_[ply][0] != move) {
+                    if (killers_[ply][0] != move) {
                         killers_[ply][1] = killers_[ply][0];
                         killers_[ply][0] = move;
                     }
@@ -2017,112 +2900,381 @@ private:
             
             if (alpha >= beta) {
                 if (!isCapture) {
-                    history_[static_cast<int>(move.from)][static_cast<int>(move.to)] += depth * depth;
+                    history_[static_cast<int>(move.from())][static_cast<int>(move.to())] += depth * depth;
                 }
                 break;
             }
         }
         
+        if (legalMoves == 0) {
+            return {inCheck ? -INFINITY_SCORE + ply : 0, std::nullopt};
+        }
+        
         uint8_t flag = (bestScore <= alphaOrig) ? 3 : (bestScore >= beta ? 2 : 1);
-        storeTT(hash, bestMove.value_or(Move()), bestScore, depth, flag);
+        tt.store(hash, bestMove.value_or(Move()), scoreToTT(bestScore, ply), staticEval, depth, flag);
         
         return {bestScore, bestMove};
     }
 
 public:
-    explicit Searcher(Board& b) : board(b) {
-        try {
-            tt.resize(ttSize);
-        } catch (const std::bad_alloc& e) {
-            std::cerr << "Warning: TT allocation failed, using 256K entries" << std::endl;
-            tt.resize(1 << 18);
-        }
-        clearTT();
-        for (auto& k : killers_) {
-            k[0] = std::nullopt;
-            k[1] = std::nullopt;
-        }
-        for (auto& row : history_) row.fill(0);
+    Searcher(TranspositionTable& table, int id) : tt(table), id_(id) {
+        clearHistory();
     }
     
-    void stop() {
-        stats.stopSearch.store(true, std::memory_order_relaxed);
-    }
+    const SearchStats& statistics() const { return stats; }
+    const std::optional<Move>& bestMove() const { return bestMove_; }
+    const std::vector<Move>& pv() const { return pv_; }
+    Score bestScore() const { return bestScore_; }
+    Depth completedDepth() const { return completedDepth_; }
     
-    int hashfull() const {
-        int used = 0;
-        const int sampleSize = std::min<int>(tt.size(), 1000);
-        for (int i = 0; i < sampleSize; ++i) {
-            if (tt[i].key != 0) used++;
-        }
-        return (used * 1000) / sampleSize; 
+    void clearHistory() {
+        for (auto& k : killers_) k.fill(Move());
+        for (auto& row : history_) row.fill(0);
     }
     
-    std::pair<std::optional<Move>, Depth> iterativeDeepening(Depth maxDepth, int64_t maxTimeMs) {
-        stats.start(maxTimeMs);
-        clearTT();
-        for (auto& k : killers_) {
-            k[0] = std::nullopt;
-            k[1] = std::nullopt;
+    // Killers and history carry over from the previous search. Killers are
+    // indexed by ply from the root, so they move up by however many plies
+    // the game has advanced; history is halved so new results dominate.
+    void prepare(const Board& root, std::atomic<bool>& stop, int64_t maxTimeMs) {
+        board = root;
+        stats.start(&stop, maxTimeMs);
+        
+        int shift = root.gamePly() - rootPly_;
+        rootPly_ = root.gamePly();
+        if (shift < 0 || shift >= MAX_KILLER_DEPTH) {
+            for (auto& k : killers_) k.fill(Move());
+        } else if (shift > 0) {
+            std::move(killers_.begin() + shift, killers_.end(), killers_.begin());
+            for (auto k = killers_.end() - shift; k != killers_.end(); ++k) k->fill(Move());
+        }
+        for (auto& row : history_) {
+            for (int& h : row) h /= 2;
         }
-        for (auto& row : history_) row.fill(0);
         
-        std::optional<Move> bestMove;
+        bestMove_.reset();
+        pv_.clear();
+        bestScore_ = 0;
+        completedDepth_ = 0;
+    }
+    
+    // Helper threads skip some depths so that threads spread over
+    // neighbouring iterations instead of all searching the same one.
+    bool skipDepth(Depth depth) const {
+        static constexpr std::array<int, 20> SKIP_SIZE = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+        static constexpr std::array<int, 20> SKIP_PHASE = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+        if (id_ == 0) return false;
+        int i = (id_ - 1) % 20;
+        return ((depth + SKIP_PHASE[i]) / SKIP_SIZE[i]) % 2 != 0;
+    }
+    
+    // onIteration is called after every completed depth, and with a bound
+    // after every failed aspiration search (main thread only).
+    void iterativeDeepening(Depth maxDepth, const std::function<void(Depth, Score, ScoreBound)>& onIteration) {
         Score prevScore = 0;
-        Depth finalDepth = 0;
         
         for (Depth currentDepth = 1; currentDepth <= maxDepth; ++currentDepth) {
             if (stats.checkTime()) break;
+            if (skipDepth(currentDepth)) continue;
             
             stats.depth = currentDepth;
             stats.seldepth = 0;
             
+            // Aspiration window around the last score. Only the side that
+            // failed is widened, by a delta that doubles on every fail. A
+            // score outside a bound that is already infinite (mated at the
+            // root) is final.
+            Score delta = ASPIRATION_DELTA;
             Score alpha = -INFINITY_SCORE;
             Score beta = INFINITY_SCORE;
-            if (currentDepth >= 5) {
-                alpha = prevScore - 50;
-                beta = prevScore + 50;
+            if (currentDepth >= ASPIRATION_MIN_DEPTH) {
+                alpha = std::max(prevScore - delta, -INFINITY_SCORE);
+                beta = std::min(prevScore + delta, INFINITY_SCORE);
             }
             
-            auto [score, move] = negamax(currentDepth, alpha, beta, 0);
-            
-            if (stats.stopSearch.load(std::memory_order_relaxed)) {
-                break;
+            Score score;
+            std::optional<Move> move;
+            while (true) {
+                int64_t searchNodes = stats.totalNodes();
+                ++stats.aspirationSearches;
+                auto result = negamax(currentDepth, alpha, beta, 0);
+                score = result.first;
+                move = result.second;
+                
+                if (stopped()) break;
+                
+                ScoreBound bound;
+                if (score <= alpha && alpha > -INFINITY_SCORE) {
+                    ++stats.aspirationFailLows;
+                    bound = ScoreBound::UPPER;
+                    alpha = delta > ASPIRATION_MAX_DELTA ? -INFINITY_SCORE : std::max(score - delta, -INFINITY_SCORE);
+                } else if (score >= beta && beta < INFINITY_SCORE) {
+                    // The move that failed high already beats the previous
+                    // best, so it is kept if time runs out before the re-search.
+                    ++stats.aspirationFailHighs;
+                    bound = ScoreBound::LOWER;
+                    beta = delta > ASPIRATION_MAX_DELTA ? INFINITY_SCORE : std::min(score + delta, INFINITY_SCORE);
+                    if (move) bestMove_ = move;
+                    if (pvLength_[0] > 0) pv_.assign(pvTable_[0].begin(), pvTable_[0].begin() + pvLength_[0]);
+                } else {
+                    break;
+                }
+                
+                stats.aspirationWastedNodes += stats.totalNodes() - searchNodes;
+                if (onIteration) onIteration(currentDepth, score, bound);
+                delta *= 2;
             }
             
-            if (score <= alpha || score >= beta) {
-                auto [fullScore, fullMove] = negamax(currentDepth, -INFINITY_SCORE, INFINITY_SCORE, 0);
-                score = fullScore;
-                move = fullMove;
-            }
+            if (stopped()) break;
             
             prevScore = score;
-            if (move) bestMove = move;
-            finalDepth = currentDepth;
+            if (move) bestMove_ = move;
+            if (pvLength_[0] > 0) pv_.assign(pvTable_[0].begin(), pvTable_[0].begin() + pvLength_[0]);
+            else if (move) pv_.assign(1, *move);
+            bestScore_ = score;
+            completedDepth_ = currentDepth;
             
+            if (onIteration) onIteration(currentDepth, score, ScoreBound::EXACT);
+            
+            if (stats.checkTime()) break;
+        }
+    }
+};
+
+// Lazy SMP: every thread runs its own iterative deepening on the same root
+// and they cooperate only through the transposition table. The calling
+// thread is the main thread; it reports progress and, once it finishes,
+// stops the helpers.
+class SearchPool {
+private:
+    TranspositionTable tt{32};
+    std::vector<std::unique_ptr<Searcher>> threads_;
+    std::atomic<bool> stop_{false};
+    
+public:
+    SearchPool() { setThreads(1); }
+    
+    void setThreads(int count) {
+        count = std::max(1, count);
+        threads_.resize(std::min<size_t>(threads_.size(), count));
+        while (static_cast<int>(threads_.size()) < count) {
+            threads_.push_back(std::make_unique<Searcher>(tt, static_cast<int>(threads_.size())));
+        }
+    }
+    
+    void stop() {
+        stop_.store(true, std::memory_order_relaxed);
+    }
+    
+    // None of these may be called while a search is running.
+    void setHashSize(size_t megabytes) { tt.resize(megabytes); }
+    void allocateHash() { tt.allocate(static_cast<int>(threads_.size())); }
+    void clearHash() { tt.clear(static_cast<int>(threads_.size())); }
+    
+    void newGame() {
+        clearHash();
+        allocateHash();
+        for (auto& t : threads_) t->clearHistory();
+    }
+    
+    int64_t nodes() const {
+        int64_t total = 0;
+        for (const auto& t : threads_) total += t->statistics().totalNodes();
+        return total;
+    }
+    
+    std::pair<std::optional<Move>, Depth> iterativeDeepening(const Board& root, Depth maxDepth, int64_t maxTimeMs) {
+        stop_ = false;
+        allocateHash();  // normally already done by isready
+        tt.newSearch();
+        for (auto& t : threads_) t->prepare(root, stop_, maxTimeMs);
+        
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < threads_.size(); ++i) {
+            helpers.emplace_back([this, i, maxDepth]() { threads_[i]->iterativeDeepening(maxDepth, nullptr); });
+        }
+        
+        Searcher& main = *threads_[0];
+        main.iterativeDeepening(maxDepth, [&](Depth depth, Score score, ScoreBound bound) {
+            const SearchStats& stats = main.statistics();
             int64_t time = stats.timeMs();
-            int64_t nps = stats.nps();
-            std::cout << "info depth " << currentDepth
+            int64_t nodes = this->nodes();
+            std::cout << "info depth " << depth
                       << " seldepth " << stats.seldepth
-                      << " score cp " << score
-                      << " nodes " << (stats.nodes + stats.qNodes)
-                      << " nps " << nps
+                      << " score cp " << score;
+            if (bound == ScoreBound::LOWER) std::cout << " lowerbound";
+            if (bound == ScoreBound::UPPER) std::cout << " upperbound";
+            std::cout << " nodes " << nodes
+                      << " nps " << nodes * 1000 / std::max<int64_t>(time, 1)
                       << " time " << time
-                      << " hashfull " << hashfull();
-            if (bestMove) std::cout << " pv " << bestMove->toUci();
+                      << " hashfull " << tt.hashfull();
+            if (!main.pv().empty()) {
+                std::cout << " pv";
+                for (const Move& m : main.pv()) std::cout << ' ' << m.toUci();
+            }
             std::cout << std::endl;
-            
-            if (stats.checkTime()) break;
+        });
+        
+        stop_ = true;
+        for (auto& h : helpers) h.join();
+        
+        int searches = 0, failHighs = 0, failLows = 0;
+        int64_t wasted = 0;
+        for (const auto& t : threads_) {
+            const SearchStats& s = t->statistics();
+            searches += s.aspirationSearches;
+            failHighs += s.aspirationFailHighs;
+            failLows += s.aspirationFailLows;
+            wasted += s.aspirationWastedNodes;
+        }
+        std::cout << "info string aspiration searches " << searches
+                  << " failhigh " << failHighs
+                  << " faillow " << failLows
+                  << " wastednodes " << wasted << std::endl;
+        
+        // A helper that completed a deeper iteration than the main thread
+        // has the more reliable move.
+        const Searcher* best = &main;
+        for (const auto& t : threads_) {
+            if (t->bestMove() && (!best->bestMove() || t->completedDepth() > best->completedDepth() ||
+                                  (t->completedDepth() == best->completedDepth() && t->bestScore() > best->bestScore()))) {
+                best = t.get();
+            }
         }
-        return {bestMove, finalDepth};
+        return {best->bestMove(), best->completedDepth()};
     }
 };
 
+// Perft
+namespace Perft {
+    // Shared, lock-free node-count cache. Each slot stores the count and the
+    // key XORed with it, so a torn write from another thread fails validation.
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> nodes{0};
+    };
+    
+    class Table {
+    private:
+        std::unique_ptr<Entry[]> entries_;
+        size_t mask_ = 0;
+        
+    public:
+        explicit Table(size_t megabytes) {
+            size_t count = 1;
+            while (count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024) count *= 2;
+            entries_.reset(new Entry[count]);
+            mask_ = count - 1;
+        }
+        
+        bool probe(uint64_t key, uint64_t& nodes) const {
+            const Entry& e = entries_[key & mask_];
+            uint64_t n = e.nodes.load(std::memory_order_relaxed);
+            if ((e.check.load(std::memory_order_relaxed) ^ n) != key) return false;
+            nodes = n;
+            return true;
+        }
+        
+        void store(uint64_t key, uint64_t nodes) {
+            Entry& e = entries_[key & mask_];
+            e.nodes.store(nodes, std::memory_order_relaxed);
+            e.check.store(key ^ nodes, std::memory_order_relaxed);
+        }
+    };
+    
+    inline uint64_t positionKey(const Board& board, Depth depth) {
+        return board.hash() ^ (static_cast<uint64_t>(depth) * 0x9e3779b97f4a7c15ULL);
+    }
+    
+    // Bulk counting: the last ply is the size of the legal move list.
+    inline uint64_t count(Board& board, Depth depth, Table* table) {
+        if (depth <= 0) return 1;
+        MoveList moves = board.generateMoves();
+        if (depth == 1) return moves.size();
+        
+        uint64_t key = 0, nodes = 0;
+        if (table) {
+            key = positionKey(board, depth);
+            if (table->probe(key, nodes)) return nodes;
+        }
+        
+        for (const auto& move : moves) {
+            board.makeMove(move);
+            nodes += count(board, depth - 1, table);
+            board.unmakeMove();
+        }
+        
+        if (table) table->store(key, nodes);
+        return nodes;
+    }
+    
+    struct Result {
+        uint64_t nodes = 0;
+        int64_t timeMs = 0;
+        std::vector<std::pair<Move, uint64_t>> divide;
+    };
+    
+    // Root moves are handed out to workers through an atomic index; each worker
+    // searches on its own copy of the board.
+    inline Result run(const Board& root, Depth depth, int threads, size_t hashMb) {
+        Result result;
+        auto start = std::chrono::steady_clock::now();
+        
+        MoveList rootMoves = root.generateMoves();
+        std::unique_ptr<Table> table;
+        if (hashMb > 0 && depth > 2) table = std::make_unique<Table>(hashMb);
+        
+        result.divide.resize(rootMoves.size());
+        std::atomic<int> nextMove{0};
+        auto worker = [&]() {
+            Board board = root;
+            int i;
+            while ((i = nextMove.fetch_add(1)) < rootMoves.size()) {
+                board.makeMove(rootMoves[i]);
+                result.divide[i] = {rootMoves[i], count(board, depth - 1, table.get())};
+                board.unmakeMove();
+            }
+        };
+        
+        if (depth <= 0) {
+            result.nodes = 1;
+            result.divide.clear();
+        } else {
+            threads = std::max(1, std::min<int>(threads, rootMoves.size()));
+            std::vector<std::thread> pool;
+            for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+            worker();
+            for (auto& t : pool) t.join();
+            for (const auto& [move, nodes] : result.divide) result.nodes += nodes;
+        }
+        
+        result.timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+    
+    struct SuiteEntry {
+        const char* fen;
+        Depth depth;
+        uint64_t nodes;
+    };
+    
+    const std::array<SuiteEntry, 8> SUITE = {{
+        {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 6, 119060324ULL},
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 5, 193690690ULL},
+        {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 7, 178633661ULL},
+        {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 5, 15833292ULL},
+        {"r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1", 5, 15833292ULL},
+        {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 5, 89941194ULL},
+        {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 5, 164075551ULL},
+        {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6, 1440467ULL},
+    }};
+}
+
 // UCI
 class UCIEngine {
 private:
     Board board;
-    Searcher searcher;
+    SearchPool searcher;
     Book book;
     Depth maxDepth = 20;
     int64_t wtime = 0, btime = 0;
@@ -2130,18 +3282,34 @@ private:
     int movestogo = 0;
     std::thread searchThread;
     std::atomic<bool> searchInProgress{false};
+    bool useNnue = false;
     
     void handleUci() {
         std::cout << "id name Hunyadi 3.0\n";
         std::cout << "id author ThatHungarian\n";
         std::cout << "option name BookFile type string default book.bin\n";
         std::cout << "option name MaxDepth type spin default 20 min 1 max 30\n";
+        std::cout << "option name EvalFile type string default hunyadi.nnue\n";
+        std::cout << "option name UseNNUE type check default false\n";
+        std::cout << "option name Threads type spin default 1 min 1 max 256\n";
+        std::cout << "option name Hash type spin default 32 min 1 max 65536\n";
+        std::cout << "option name Clear Hash type button\n";
         std::cout << "uciok" << std::endl;
     }
     
-    void handleIsReady() { std::cout << "readyok" << std::endl; }
+    // GUIs send isready before the first go, so the hash table is set up
+    // here, before any clock is running.
+    void handleIsReady() {
+        if (!searchInProgress) searcher.allocateHash();
+        std::cout << "readyok" << std::endl;
+    }
     
     void handleNewGame() {
+        if (searchThread.joinable()) {
+            searcher.stop();
+            searchThread.join();
+        }
+        searcher.newGame();
         board.reset();
         if (!book.isLoaded()) book.load("book.bin");
     }
@@ -2206,8 +3374,8 @@ private:
                         if (fromFile >= 0 && fromFile < 8 && fromRank >= 0 && fromRank < 8 &&
                             toFile >= 0 && toFile < 8 && toRank >= 0 && toRank < 8) {
                             
-                            Square from = static_cast<Square>(fromRank * 8 + fromFile);
-                            Square to = static_cast<Square>(toRank * 8 + toFile);
+                            int from = fromRank * 8 + fromFile;
+                            int to = toRank * 8 + toFile;
                             
                             PieceType promo = PieceType::NONE;
                             if (token.length() == 5) {
@@ -2219,9 +3387,8 @@ private:
                                 }
                             }
                             
-                            Move move(from, to, promo);
-                            auto legalMoves = board.generateMoves();
-                            if (std::find(legalMoves.begin(), legalMoves.end(), move) != legalMoves.end()) {
+                            Move move = board.decodeMove(Move::pack(from, to, promo));
+                            if (board.generateMoves().contains(move)) {
                                 board.makeMove(move);
                             }
                         }
@@ -2247,8 +3414,8 @@ private:
                         if (fromFile >= 0 && fromFile < 8 && fromRank >= 0 && fromRank < 8 &&
                             toFile >= 0 && toFile < 8 && toRank >= 0 && toRank < 8) {
                             
-                            Square from = static_cast<Square>(fromRank * 8 + fromFile);
-                            Square to = static_cast<Square>(toRank * 8 + toFile);
+                            int from = fromRank * 8 + fromFile;
+                            int to = toRank * 8 + toFile;
                             
                             PieceType promo = PieceType::NONE;
                             if (token.length() == 5) {
@@ -2260,9 +3427,8 @@ private:
                                 }
                             }
                             
-                            Move move(from, to, promo);
-                            auto legalMoves = board.generateMoves();
-                            if (std::find(legalMoves.begin(), legalMoves.end(), move) != legalMoves.end()) {
+                            Move move = board.decodeMove(Move::pack(from, to, promo));
+                            if (board.generateMoves().contains(move)) {
                                 board.makeMove(move);
                             }
                         }
@@ -2272,6 +3438,67 @@ private:
         }
     }
     
+    void printPerft(const Perft::Result& result, Depth depth, bool divide) {
+        if (divide) {
+            for (const auto& [move, nodes] : result.divide) {
+                std::cout << move.toUci() << ": " << nodes << "\n";
+            }
+            std::cout << "\n";
+        }
+        std::cout << "info depth " << depth
+                  << " nodes " << result.nodes
+                  << " time " << result.timeMs
+                  << " nps " << result.nodes * 1000 / std::max<int64_t>(result.timeMs, 1) << "\n";
+        std::cout << "Nodes searched: " << result.nodes << std::endl;
+    }
+    
+    // perft <depth> [divide] [threads <n>] [hash <mb>]
+    // perft suite [threads <n>] [hash <mb>]
+    void handlePerft(std::istringstream& iss, bool divide) {
+        std::string token;
+        Depth depth = 1;
+        bool suite = false;
+        int threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t hashMb = 0;
+        
+        while (iss >> token) {
+            if (token == "suite") suite = true;
+            else if (token == "divide") divide = true;
+            else if (token == "threads") iss >> threads;
+            else if (token == "hash") iss >> hashMb;
+            else if (std::isdigit(static_cast<unsigned char>(token[0]))) depth = std::stoi(token);
+        }
+        
+        if (searchThread.joinable()) {
+            searcher.stop();
+            searchThread.join();
+        }
+        
+        if (!suite) {
+            printPerft(Perft::run(board, depth, threads, hashMb), depth, divide);
+            return;
+        }
+        
+        uint64_t totalNodes = 0;
+        int64_t totalTime = 0;
+        int failures = 0;
+        for (const auto& entry : Perft::SUITE) {
+            Board position;
+            position.setFen(entry.fen);
+            auto result = Perft::run(position, entry.depth, threads, hashMb);
+            bool ok = result.nodes == entry.nodes;
+            if (!ok) ++failures;
+            totalNodes += result.nodes;
+            totalTime += result.timeMs;
+            std::cout << (ok ? "ok   " : "FAIL ") << entry.fen << " depth " << entry.depth
+                      << " nodes " << result.nodes << " expected " << entry.nodes
+                      << " time " << result.timeMs << "\n";
+        }
+        std::cout << "perft suite: " << (Perft::SUITE.size() - failures) << "/" << Perft::SUITE.size() << " passed"
+                  << ", nodes " << totalNodes << ", time " << totalTime
+                  << ", nps " << totalNodes * 1000 / std::max<int64_t>(totalTime, 1) << std::endl;
+    }
+    
     void handleGo(std::istringstream& iss) {
         std::string token;
         int64_t moveTime = -1; 
@@ -2281,7 +3508,10 @@ private:
         movestogo = 0;
         
         while (iss >> token) {
-            if (token == "depth") {
+            if (token == "perft") {
+                handlePerft(iss, true);
+                return;
+            } else if (token == "depth") {
                 iss >> maxDepth;
             } else if (token == "movetime") {
                 iss >> moveTime;
@@ -2320,11 +3550,11 @@ private:
                 if (bookMove) {
                     std::cout << "bestmove " << bookMove->toUci() << std::endl;
                 } else {
-                    auto [bestMove, finalDepth] = searcher.iterativeDeepening(maxDepth, moveTime);
+                    auto [bestMove, finalDepth] = searcher.iterativeDeepening(board, maxDepth, moveTime);
                     if (bestMove) {
                         std::cout << "bestmove " << bestMove->toUci() << std::endl;
                     } else {
-                        auto moves = board.generateMoves();
+                        MoveList moves = board.generateMoves();
                         if (!moves.empty()) std::cout << "bestmove " << moves[0].toUci() << std::endl;
                         else std::cout << "bestmove 0000" << std::endl;
                     }
@@ -2339,13 +3569,41 @@ private:
     
     void handleSetOption(std::istringstream& iss) {
         std::string token, name, value;
-        iss >> token >> name >> token >> value;
+        iss >> token;
+        while (iss >> token && token != "value") name += (name.empty() ? "" : " ") + token;
+        iss >> value;
+        
+        if (name == "Threads" || name == "Hash" || name == "Clear Hash" || name == "EvalFile" || name == "UseNNUE") {
+            if (searchThread.joinable()) {
+                searcher.stop();
+                searchThread.join();
+            }
+        }
+        
         if (name == "MaxDepth") maxDepth = std::stoi(value);
         else if (name == "BookFile") book.load(value);
+        else if (name == "EvalFile") {
+            // "random" installs a seeded random net for testing.
+            if (value == "random") Nnue::randomize(1);
+            else if (!Nnue::load(value)) std::cerr << "info string NNUE file not loaded: " << value << std::endl;
+        }
+        else if (name == "UseNNUE") useNnue = (value == "true");
+        else if (name == "Threads") searcher.setThreads(std::stoi(value));
+        else if (name == "Hash") searcher.setHashSize(std::stoul(value));
+        else if (name == "Clear Hash") searcher.clearHash();
+        
+        // TT entries carry static evals from the old evaluator.
+        if (name == "EvalFile" || name == "UseNNUE") {
+            Nnue::active = (useNnue && Nnue::network) ? Nnue::network.get() : nullptr;
+            board.refreshAccumulators();
+            searcher.clearHash();
+        }
     }
     
 public:
-    UCIEngine() : board(), searcher(board) {}
+    UCIEngine() : board(), searcher() {
+        Nnue::load("hunyadi.nnue");
+    }
     
     void loop() {
         std::string line;
@@ -2360,6 +3618,7 @@ public:
             else if (cmd == "position") handlePosition(iss);
             else if (cmd == "go") handleGo(iss);
             else if (cmd == "setoption") handleSetOption(iss);
+            else if (cmd == "perft") handlePerft(iss, false);
             else if (cmd == "stop") {
                 if (searchInProgress) {
                     searcher.stop();
@@ -2370,11 +3629,9 @@ public:
                 }
             }
             else if (cmd == "quit") {
-                if (searchInProgress) {
-                    searcher.stop();
-                    if (searchThread.joinable()) {
-                        searchThread.join();
-                    }
+                searcher.stop();
+                if (searchThread.joinable()) {
+                    searchThread.join();
                 }
                 break;
             }
@@ -2385,6 +3642,9 @@ public:
 
 // Main
 int main() {
+    Attacks::init();
+    Zobrist::init();
+    Pst::init();
     UCIEngine engine;
     engine.loop();
     return 0;